@@ -24,6 +24,7 @@ include $(CLEAR_VARS)
 LOCAL_MODULE := SeetaFaceRecognizer610
 
 LOCAL_CFLAGS += -DSEETA_MODEL_ENCRYPT
+LOCAL_CFLAGS += -DSEETA_STAGE_TIMERS
 
 MY_CPP_LIST := $(wildcard $(LOCAL_PATH)/seeta/*.cpp)
 MY_CPP_LIST += $(wildcard $(LOCAL_PATH)/src/seeta/*.cpp)
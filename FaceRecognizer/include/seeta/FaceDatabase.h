@@ -6,6 +6,7 @@
 
 #include <string>
 #include <vector>
+#include <functional>
 
 namespace seeta
 {
@@ -18,8 +19,58 @@ namespace seeta
 		class FaceDatabase
 		{
 		public:
+            enum Property {
+                PROPERTY_PREFILTER_CANDIDATES = 1,  ///< QueryTop re-ranks only such many nearest rows by sign-bit hamming distance, 0 for exhaustive scan (default)
+                PROPERTY_AGGREGATION_TOP_K = 2,     ///< templates averaged by AGGREGATION_MEAN_TOP_K, 3 for default
+                PROPERTY_CENTROID_CANDIDATES = 3,   ///< QueryTopIdentities ranks identity centroids first and expands only such many identities, 0 for expanding all (default)
+                PROPERTY_SOFTMAX_TEMPERATURE = 4,   ///< temperature of AGGREGATION_SOFTMAX, 0.1 for default
+                PROPERTY_BUFFER_ALLOCATIONS = 5,    ///< read only, request buffers taken from system by all databases, stops growing in steady state
+                PROPERTY_BUFFER_REUSES = 6,         ///< read only, request buffers served from pool
+                PROPERTY_RESERVED_EXTRACTION_CORES = 7, ///< extraction cores never taking bulk registrations, a quarter of cores for default, at most all but one
+                PROPERTY_EXPIRED_REGISTRATIONS = 8, ///< read only, bulk registrations dropped for missing their deadline
+                PROPERTY_EXTRACTION_CORES = 9,      ///< model instances extracting at once, setting it waits registrations and resets reserved cores, new extractions wait meanwhile
+                PROPERTY_CORE_THREADS = 10,         ///< intra-op threads of each extraction core, setting it waits registrations, new extractions wait meanwhile
+            };
+
+            enum Aggregation {
+                AGGREGATION_MAX = 0,        ///< best template of identity
+                AGGREGATION_MEAN_TOP_K = 1, ///< mean of best PROPERTY_AGGREGATION_TOP_K templates of identity
+                AGGREGATION_MEAN = 2,       ///< mean of all scores
+                AGGREGATION_SOFTMAX = 3,    ///< scores weighted by exp(score / PROPERTY_SOFTMAX_TEMPERATURE)
+            };
+
+            enum ClusterMethod {
+                CLUSTER_CONNECTED_COMPONENTS = 0,   ///< faces linked by any edge share cluster
+                CLUSTER_CHINESE_WHISPERS = 1,       ///< label propagation weighted by similarity, splits weakly linked groups
+            };
+
+            enum TuneTarget {
+                TUNE_THROUGHPUT = 0,    ///< most extractions per second
+                TUNE_P99_LATENCY = 1,   ///< lowest p99 extraction latency at given request rate
+            };
+
+            /**
+             * \brief called with (query, index, similarity) when new face index matches standing query
+             */
+            using StandingCallback = std::function<void(int64_t, int64_t, float)>;
+
+            /**
+             * \brief called with (index1, index2, similarity) for each pair found by ComparePairs
+             */
+            using PairCallback = std::function<void(int64_t, int64_t, float)>;
+
 			SEETA_API explicit FaceDatabase(const SeetaModelSetting &setting);
+			/**
+			 * \param extraction_core_number model instances, extractions running at once
+			 * \param comparation_core_number blocks each scan is split into
+			 * \note both run on worker threads shared by all databases, see SetThreadBudget
+			 */
 			SEETA_API explicit FaceDatabase(const SeetaModelSetting &setting, int extraction_core_number, int comparation_core_number);
+			/**
+			 * \brief model-free database of feature_size floats per face, compared by inner product
+			 * \note only *ByFeatures, multi-probe, standing, pair and storage APIs work, image APIs fail; for precomputed features and benchmarks
+			 */
+			SEETA_API explicit FaceDatabase(int feature_size, int comparation_core_number = 1);
 			SEETA_API ~FaceDatabase();
 
 			/**
@@ -33,6 +84,19 @@ namespace seeta
 			 *  FATAL = 4,
 			 */
             SEETA_API static int SetLogLevel(int level);
+            /**
+             * \brief set worker threads shared by extraction, comparison and insertion of all databases
+             * \param threads 0 for hardware concurrency (default)
+             * \return threads used, takes effect only before the first database is constructed
+             */
+            SEETA_API static int SetThreadBudget(int threads);
+            /**
+             * \brief pin shared worker threads to CPU sets of NUMA nodes, extraction core i of each database then runs on node i % nodes,
+             *  its model instance and scratch are allocated there, and threads its engine starts inherit the node CPU set
+             * \return NUMA nodes used, 0 if disabled or not supported on this platform
+             * \note linux only, takes effect only before the first database is constructed
+             */
+            SEETA_API static int SetNumaPlacement(bool enabled);
 
             SEETA_API  int GetCropFaceWidthV2();
             SEETA_API  int GetCropFaceHeightV2();
@@ -50,6 +114,7 @@ namespace seeta
 
             SEETA_API int64_t Register(const SeetaImageData &image, const SeetaPointF *points);
             SEETA_API int64_t RegisterByCroppedFace(const SeetaImageData &cropped_face_image);
+            SEETA_API int64_t RegisterByFeatures(const float *features);    // unit-norm features, like extracted ones
             SEETA_API int Delete(int64_t index);    // return effected lines, 1 for succeed, 0 for nothing
             SEETA_API void Clear(); // clear all faces
 
@@ -59,23 +124,141 @@ namespace seeta
  
             SEETA_API size_t QueryTop(const SeetaImageData &image, const SeetaPointF *points, size_t N, int64_t *index, float *similarity) const;    // return top N faces
             SEETA_API size_t QueryTopByCroppedFace(const SeetaImageData &cropped_face_image, size_t N, int64_t *index, float *similarity) const;    // return top N faces
+            SEETA_API size_t QueryTopByFeatures(const float *features, size_t N, int64_t *index, float *similarity) const;    // return top N faces
 
 
             SEETA_API size_t QueryAbove(const SeetaImageData &image, const SeetaPointF *points, float threshold, size_t N, int64_t *index, float *similarity) const;
             SEETA_API size_t QueryAboveByCroppedFace(const SeetaImageData &cropped_face_image, float threshold, size_t N, int64_t *index, float *similarity) const;
+            SEETA_API size_t QueryAboveByFeatures(const float *features, float threshold, size_t N, int64_t *index, float *similarity) const;
+
+            SEETA_API int Tag(int64_t index, int32_t tag);  // put face into partition tag, return effected lines, 1 for succeed, 0 for nothing
+            SEETA_API int Untag(int64_t index, int32_t tag);    // return effected lines, 1 for succeed, 0 for nothing
+
+            // only faces having all tags are compared, cost is proportional to the selected faces
+            SEETA_API size_t QueryTopInPartition(const SeetaImageData &image, const SeetaPointF *points, const int32_t *tags, size_t tag_count, size_t N, int64_t *index, float *similarity) const;
+            SEETA_API size_t QueryTopByCroppedFaceInPartition(const SeetaImageData &cropped_face_image, const int32_t *tags, size_t tag_count, size_t N, int64_t *index, float *similarity) const;
+
+            SEETA_API size_t QueryAboveInPartition(const SeetaImageData &image, const SeetaPointF *points, const int32_t *tags, size_t tag_count, float threshold, size_t N, int64_t *index, float *similarity) const;
+            SEETA_API size_t QueryAboveByCroppedFaceInPartition(const SeetaImageData &cropped_face_image, const int32_t *tags, size_t tag_count, float threshold, size_t N, int64_t *index, float *similarity) const;
+
+            SEETA_API int Bind(int64_t index, int64_t identity);   // add face as template of identity (>= 0), rebinding moves it, return effected lines
+            SEETA_API int Unbind(int64_t index);    // return effected lines, 1 for succeed, 0 for nothing
+            SEETA_API int64_t GetIdentity(int64_t index) const; // return -1 for unbound face
+
+            // return top N distinct identities, faces not bound to any identity are ignored
+            SEETA_API size_t QueryTopIdentities(const SeetaImageData &image, const SeetaPointF *points, Aggregation aggregation, size_t N, int64_t *identity, float *similarity) const;
+            SEETA_API size_t QueryTopIdentitiesByCroppedFace(const SeetaImageData &cropped_face_image, Aggregation aggregation, size_t N, int64_t *identity, float *similarity) const;
+            SEETA_API size_t QueryTopIdentitiesByFeatures(const float *features, Aggregation aggregation, size_t N, int64_t *identity, float *similarity) const;
+
+            /**
+             * \brief score k probes of one track against each face in a single pass, fuse scores of each face by aggregation
+             * \param probes k extracted features, GetExtractFeatureSize() floats each
+             * \return top N faces
+             */
+            SEETA_API size_t QueryTopMultiProbe(const float *probes, size_t k, Aggregation aggregation, size_t N, int64_t *index, float *similarity) const;
+
+            /**
+             * \brief watch every face registered from now on, matches above threshold call standing callback asynchronously
+             * \param probe extracted features, GetExtractFeatureSize() floats
+             * \return id of standing query, standing queries are not saved with database
+             */
+            SEETA_API int64_t AddStandingQuery(const float *probe, float threshold);
+            SEETA_API int RemoveStandingQuery(int64_t query);   // return effected lines, 1 for succeed, 0 for nothing
+            SEETA_API void SetStandingCallback(const StandingCallback &callback);
+            SEETA_API void JoinAlerts() const;  // wait all fired callbacks
+
+            /**
+             * \brief compare all faces with each other, tile by tile on comparation cores, pairs are streamed to callback
+             * \param threshold only pairs with similarity >= threshold are reported
+             * \param top_k 0 for reporting each pair once, or only best top_k neighbours of each face
+             * \param checkpoint file recording finished blocks and the gallery version, an interrupted job is resumed from it, nullptr for none
+             * \return false if checkpoint belongs to other job or gallery, or faces were deleted while running
+             * \note callback is called from one thread at a time without database lock, a resumed job may repeat pairs of the block being interrupted;
+             *  job takes faces stored when it starts, or when checkpoint was created, and reads gallery one tile a time,
+             *  so registrations and queries go on, and faces registered meanwhile are not compared;
+             *  Delete, Clear, Load and LearnRotation stop a running job, and a checkpoint can not be resumed after Delete,
+             *  or after Load of a gallery saved with deleted faces, which moves faces to other slots
+             */
+            SEETA_API bool ComparePairs(float threshold, size_t top_k, const PairCallback &callback, const char *checkpoint = nullptr) const;
+
+            /**
+             * \brief cluster all faces into identities over kNN graph
+             * \param threshold only edges with similarity >= threshold are kept
+             * \param k neighbours of each face in graph
+             * \param index [out] Count() faces
+             * \param cluster [out] cluster id of each face, from 0, faces without edges are clusters of their own
+             * \return number of faces written, 0 if faces were deleted while running
+             * \note like ComparePairs, faces stored at start are clustered and gallery is read one tile a time,
+             *  so registrations and queries go on; faces registered meanwhile are not written, Delete, Clear, Load
+             *  and LearnRotation stop clustering
+             */
+            SEETA_API size_t Cluster(float threshold, size_t k, ClusterMethod method, int64_t *index, int64_t *cluster) const;
 
             SEETA_API void RegisterParallel(const SeetaImageData &image, const SeetaPointF *points, int64_t *index);
             SEETA_API void RegisterByCroppedFaceParallel(const SeetaImageData &cropped_face_image, int64_t *index);
-            SEETA_API void Join() const;
+            /**
+             * \brief like RegisterParallel, but frame is shared with worker instead of cropped on caller thread
+             * \note pixels of image must not be changed before Join
+             */
+            SEETA_API void RegisterSharedParallel(const seeta::ImageData &image, const SeetaPointF *points, int64_t *index);
+            /**
+             * \brief low priority registration for enrollment batches, extracted only when no query or interactive registration is waiting
+             * \param deadline_ms dropped with index -1 if not started within such many milliseconds, negative for no deadline
+             * \note blocks while bulk queue is full; queries do not wait for bulk registrations, call JoinBulk or Join for that
+             */
+            SEETA_API void RegisterBulkParallel(const SeetaImageData &image, const SeetaPointF *points, int64_t *index, int64_t deadline_ms = -1);
+            SEETA_API void RegisterBulkByCroppedFaceParallel(const SeetaImageData &cropped_face_image, int64_t *index, int64_t deadline_ms = -1);
+            SEETA_API void Join() const;    // wait all registrations
+            SEETA_API void JoinBulk() const;    // wait bulk registrations
 
+            /**
+             * \brief save features, plain databases keep the original format
+             * \note once rotation, tags or identities are set, file is written in extended format (magic 0x7727),
+             *       which versions before sections can not load; Load reads both
+             */
             SEETA_API bool Save(const char *path) const;
+            /**
+             * \brief load features saved by Save, rows of duplicated index are merged and the last one is kept
+             */
             SEETA_API bool Load(const char *path);
 
             SEETA_API bool Save(StreamWriter &writer) const;
             SEETA_API bool Load(StreamReader &reader);
 
+            /**
+             * \brief learn PCA rotation from stored faces and rotate them, high-energy dimensions come first
+             * \return false if database is empty or model does not compare features by inner product
+             * \note QueryAbove then stops scanning a face once it can not reach threshold; rotation is saved with database
+             */
+            SEETA_API bool LearnRotation();
+
+            /**
+             * \brief time synthetic extractions with each extraction cores x intra-op threads within thread budget, apply the best
+             * \param qps request rate of TUNE_P99_LATENCY, ignored by TUNE_THROUGHPUT
+             * \param path configuration is loaded from it if tuned for same target, qps, thread budget and feature size, else tuned and saved to it; nullptr for not persisted
+             * \return false if qps is missing for TUNE_P99_LATENCY
+             * \note call before serving, it waits registrations and replaces extraction cores; result is in PROPERTY_EXTRACTION_CORES and PROPERTY_CORE_THREADS.
+             *  Thread budget is the number of shared executor workers and bounds cores x threads only; TenniS intra-op threads are
+             *  created on top of the workers, and query comparisons run on the workers meanwhile, so it is not a bound of all threads
+             */
+            SEETA_API bool Autotune(TuneTarget target, double qps = 0, const char *path = nullptr);
+
+            /**
+             * \return extraction core i, valid until PROPERTY_EXTRACTION_CORES, PROPERTY_CORE_THREADS or Autotune replace cores
+             */
             SEETA_API FaceRecognizer *ExtractionCore(int i = 0);
 
+            SEETA_API void set(Property property, double value);
+
+            SEETA_API double get(Property property) const;
+
+            /**
+             * \brief counters, histograms and gauges of this database in Prometheus text exposition format, names prefixed by seeta_face_database_
+             * \return query latency and rows scanned by query type, insert latency, lock wait, registrations, queue depths and memory bytes by component
+             * \note takes the database lock briefly for sizes, cheap enough for each scrape
+             */
+            SEETA_API std::string GetMetrics() const;
+
 		private:
 			FaceDatabase(const FaceDatabase &other) = delete;
 			const FaceDatabase &operator=(const FaceDatabase &other) = delete;
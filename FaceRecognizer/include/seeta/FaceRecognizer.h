@@ -8,6 +8,8 @@
 #include "Common/Struct.h"
 #include "seeta/SeetaFaceRecognizerConfig.h"
 
+#include <string>
+
 // #define SEETA_FACE_RECOGNIZER_MAJOR_VERSION 6
 // #define SEETA_FACE_RECOGNIZER_MINOR_VERSION 0
 // #define SEETA_FACE_RECOGNIZER_SINOR_VERSION 0
@@ -19,7 +21,51 @@ namespace seeta {
             using self = FaceRecognizer;
             enum Property {
                  PROPERTY_NUMBER_THREADS = 4,
-                 PROPERTY_ARM_CPU_MODE = 5
+                 PROPERTY_ARM_CPU_MODE = 5,
+                 PROPERTY_EXTRACTION_CACHE_SIZE = 6,    ///< features cached by cropped face, entries keep crop bytes to verify hits, shared with clones, 0 for disabled (default)
+                 PROPERTY_EXTRACTION_CACHE_HITS = 7,    ///< read only
+                 PROPERTY_EXTRACTION_CACHE_MISSES = 8,  ///< read only
+            };
+
+            enum Stage {
+                STAGE_CROP = 0,         ///< affine crop of face from frame
+                STAGE_CACHE = 1,        ///< hash and lookup of cropped face, only with extraction cache
+                STAGE_PREPROCESS = 2,   ///< input tensor and image filter of model
+                STAGE_INFERENCE = 3,    ///< forward of model
+                STAGE_OUTPUT = 4,       ///< cast and copy of output, and sqrt post processing
+                STAGE_NORMALIZE = 5,    ///< normalization of features
+            };
+
+            static const int STAGE_BUCKETS = 32;
+
+            struct StageStats {
+                uint64_t count;     ///< timed runs
+                double total_us;
+                double mean_us;
+                double p50_us;      ///< upper bound of histogram bucket holding p50
+                double p99_us;      ///< upper bound of histogram bucket holding p99
+                uint64_t buckets[STAGE_BUCKETS];    ///< bucket i counts runs taking [2^i, 2^(i+1)) ns, the last one is open
+            };
+
+            enum YUVFormat {
+                YUV_NV12 = 0,   ///< Y plane, then interleaved UV plane at half resolution
+                YUV_NV21 = 1,   ///< Y plane, then interleaved VU plane at half resolution
+                YUV_I420 = 2,   ///< Y, U and V planes, U and V at half resolution
+            };
+
+            /**
+             * camera frame in planes of BT.601 limited range, as decoders emit it
+             */
+            struct YUVImageData {
+                int width;
+                int height;
+                YUVFormat format;
+                const uint8_t *y;
+                int y_stride;       ///< bytes between rows of y
+                const uint8_t *uv;  ///< UV plane of NV12, VU plane of NV21, U plane of I420
+                int uv_stride;
+                const uint8_t *v;   ///< V plane of I420, unused by NV12 and NV21
+                int v_stride;
             };
 
             SEETA_API explicit FaceRecognizer(const SeetaModelSetting &setting);
@@ -41,6 +87,26 @@ namespace seeta {
 
             SEETA_API float CalculateSimilarity(const float *features1, const float *features2) const;
 
+            /**
+             * calculate similarity of features with N rows, the i-th row starts at rows + i * stride
+             */
+            SEETA_API void CalculateSimilarityMany(const float *features, const float *rows, size_t stride, size_t N, float *similarity) const;
+
+            /**
+             * @return the lowest inner product of features reaching similarity, -FLT_MAX if it can not be bounded
+             */
+            SEETA_API float GetInnerProductThreshold(float similarity) const;
+
+            /**
+             * @return true if features are compared by inner product, so rotating both sides keeps the score
+             */
+            SEETA_API bool IsInnerProductCompare() const;
+
+            /**
+             * map N inner products of features to similarity, only valid when GetInnerProductThreshold can bound the compare op
+             */
+            SEETA_API void CalculateSimilarityFromInnerProduct(const float *inner_products, size_t N, float *similarity) const;
+
             static seeta::ImageData CropFace(const SeetaImageData &image, const SeetaPointF *points) {
                 seeta::ImageData face(GetCropFaceWidth(), GetCropFaceHeight(), GetCropFaceChannels());
                 CropFace(image, points, face);
@@ -53,8 +119,21 @@ namespace seeta {
 
             SEETA_API int GetCropFaceChannelsV2() const;
 
+            /**
+             * \note crop runs without compute context, so one recognizer crops on many threads at once
+             */
             SEETA_API bool CropFaceV2(const SeetaImageData &image, const SeetaPointF *points, SeetaImageData &face);
 
+            /**
+             * \brief crop BGR face from camera frame, each output pixel is sampled from planes and converted inside warp
+             * \param face GetCropFaceWidthV2() x GetCropFaceHeightV2() x 3
+             * \return false if model does not take 3 channel faces
+             * \note the whole frame is never converted
+             */
+            SEETA_API bool CropFaceV2(const YUVImageData &image, const SeetaPointF *points, SeetaImageData &face);
+
+            SEETA_API bool Extract(const YUVImageData &image, const SeetaPointF *points, float *features) const;
+
             seeta::ImageData CropFaceV2(const SeetaImageData &image, const SeetaPointF *points) {
                 seeta::ImageData face(GetCropFaceWidthV2(), GetCropFaceHeightV2(), GetCropFaceChannelsV2());
                 CropFaceV2(image, points, face);
@@ -65,6 +144,27 @@ namespace seeta {
 
             SEETA_API double get(Property property) const;
 
+            /**
+             * \brief latency histogram of stage, over all recognizers and threads of the process, since last ResetStats
+             * \return false if library is built without SEETA_STAGE_TIMERS, stats are all zero then
+             */
+            SEETA_API static bool GetStats(Stage stage, StageStats &stats);
+
+            SEETA_API static void ResetStats();
+
+            /**
+             * \brief record phases of requests of all recognizers and databases into per-thread rings, disabled for default
+             * \note phases are enqueue, crop, preprocess, inference, insert, lock wait, scan, sort and join; extraction stages need SEETA_STAGE_TIMERS
+             */
+            SEETA_API static void SetTracing(bool enabled);
+
+            /**
+             * \return latest events of each thread since last ClearTrace, as Chrome trace JSON, loadable by chrome://tracing and Perfetto UI
+             */
+            SEETA_API static std::string DumpTrace();
+
+            SEETA_API static void ClearTrace();
+
 
         private:
             FaceRecognizer(const FaceRecognizer &) = delete;
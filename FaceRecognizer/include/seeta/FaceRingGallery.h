@@ -0,0 +1,61 @@
+#pragma once
+
+#include "Common/Struct.h"
+#include "SeetaFaceRecognizerConfig.h"
+
+namespace seeta
+{
+    namespace SEETA_FACE_RECOGNIZE_NAMESPACE_VERSION
+    {
+        class FaceRecognizer;
+        /**
+         * \brief Fixed size gallery of recently seen faces, for short term re-identification
+         * \note faces live in preallocated ring of capacity slots, in order of timestamp;
+         *  registration and expiry never allocate, the oldest face is overwritten once ring is full
+         */
+        class FaceRingGallery
+        {
+        public:
+            /**
+             * \param capacity max faces kept
+             * \param ttl faces older than (now - ttl) are dropped by Expire, in unit of timestamps
+             */
+            SEETA_API explicit FaceRingGallery(const SeetaModelSetting &setting, size_t capacity, int64_t ttl);
+            SEETA_API ~FaceRingGallery();
+
+            /**
+             * \param timestamp should not go back, older timestamp is taken as the latest one
+             * \return index of face, increasing from 0, -1 if failed
+             */
+            SEETA_API int64_t Register(const SeetaImageData &image, const SeetaPointF *points, int64_t timestamp);
+            SEETA_API int64_t RegisterByCroppedFace(const SeetaImageData &cropped_face_image, int64_t timestamp);
+            SEETA_API int64_t RegisterFeatures(const float *features, int64_t timestamp);
+
+            SEETA_API size_t Expire(int64_t now);   // return dropped faces
+            SEETA_API void Clear();
+
+            SEETA_API size_t Count() const;
+            SEETA_API size_t Capacity() const;
+            SEETA_API int64_t GetTimestamp(int64_t index) const;    // return -1 for dropped face
+
+            /**
+             * \brief only faces seen in [since, until] are compared
+             * \return top N faces
+             */
+            SEETA_API size_t QueryTop(const SeetaImageData &image, const SeetaPointF *points, int64_t since, int64_t until, size_t N, int64_t *index, float *similarity) const;
+            SEETA_API size_t QueryTopByCroppedFace(const SeetaImageData &cropped_face_image, int64_t since, int64_t until, size_t N, int64_t *index, float *similarity) const;
+            SEETA_API size_t QueryTopByFeatures(const float *features, int64_t since, int64_t until, size_t N, int64_t *index, float *similarity) const;
+
+            SEETA_API FaceRecognizer *ExtractionCore();
+
+        private:
+            FaceRingGallery(const FaceRingGallery &other) = delete;
+            const FaceRingGallery &operator=(const FaceRingGallery &other) = delete;
+
+        private:
+            class Implement;
+            Implement *m_impl;
+        };
+    }
+    using namespace SEETA_FACE_RECOGNIZE_NAMESPACE_VERSION;
+}
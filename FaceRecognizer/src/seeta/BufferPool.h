@@ -0,0 +1,174 @@
+#ifndef SEETA_FACERECOGNIZER_BUFFERPOOL_H
+#define SEETA_FACERECOGNIZER_BUFFERPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace seeta {
+    /**
+     * Process wide pool of power-of-two sized buffers, for per request features, crops and scores.
+     * Each thread keeps a few buffers of each size class, so steady state acquire and release take no lock.
+     * Bytes kept in each class are capped too, so gallery sized score arrays are kept a few at most and
+     * memory held by idle pool stays bounded; buffers larger than the biggest class go straight to the system.
+     */
+    class BufferPool {
+    public:
+        using self = BufferPool;
+
+        static const int MIN_CLASS = 6;     ///< 64 bytes
+        static const int MAX_CLASS = 22;    ///< 4M bytes, score arrays of about 1M faces
+        static const int CLASSES = MAX_CLASS - MIN_CLASS + 1;
+        static const size_t THREAD_CACHE = 4;   ///< buffers kept by each thread in each class
+        static const size_t THREAD_CACHE_BYTES = size_t(1) << 18;  ///< bytes kept by each thread in each class
+        static const size_t GLOBAL_CACHE = 64;  ///< buffers kept by pool in each class
+        static const size_t GLOBAL_CACHE_BYTES = size_t(1) << 22;  ///< bytes kept by pool in each class, so about 32M over all classes
+
+        /**
+         * never destroyed, so caches of threads exiting late can still flush into it
+         */
+        static self &Global() {
+            static self *pool = new self;
+            return *pool;
+        }
+
+        void *acquire(size_t bytes) {
+            const auto c = size_class(bytes);
+            if (c < 0) {
+                ++m_allocations;
+                return ::operator new(bytes);
+            }
+            auto &cache = Local().free[c];
+            if (!cache.empty()) {
+                auto buffer = cache.back();
+                cache.pop_back();
+                ++m_reuses;
+                return buffer;
+            }
+            {
+                std::unique_lock<std::mutex> _locker(m_mutex);
+                if (!m_free[c].empty()) {
+                    auto buffer = m_free[c].back();
+                    m_free[c].pop_back();
+                    ++m_reuses;
+                    return buffer;
+                }
+            }
+            ++m_allocations;
+            return ::operator new(size_t(1) << (c + MIN_CLASS));
+        }
+
+        void release(void *buffer, size_t bytes) {
+            if (buffer == nullptr) return;
+            const auto c = size_class(bytes);
+            if (c < 0) {
+                ::operator delete(buffer);
+                return;
+            }
+            auto &cache = Local().free[c];
+            if (cache.size() < kept(c, THREAD_CACHE, THREAD_CACHE_BYTES)) {
+                cache.push_back(buffer);
+                return;
+            }
+            give_back(c, buffer);
+        }
+
+        /**
+         * @return count elements of T in pooled buffer, given back to pool with the last reference
+         */
+        template <typename T>
+        std::shared_ptr<T> shared(size_t count) {
+            const auto bytes = count * sizeof(T);
+            return std::shared_ptr<T>(static_cast<T *>(acquire(bytes)), [bytes](T *buffer) {
+                Global().release(buffer, bytes);
+            });
+        }
+
+        uint64_t allocations() const { return m_allocations; }  ///< buffers newly taken from system
+
+        uint64_t reuses() const { return m_reuses; }    ///< buffers served from pool
+
+    private:
+        BufferPool() = default;
+
+        static int size_class(size_t bytes) {
+            int c = MIN_CLASS;
+            while (c <= MAX_CLASS && (size_t(1) << c) < bytes) ++c;
+            return c > MAX_CLASS ? -1 : c - MIN_CLASS;
+        }
+
+        /**
+         * @return buffers of class c kept in a cache of count buffers and bytes
+         */
+        static size_t kept(int c, size_t count, size_t bytes) {
+            return std::min(count, bytes >> (c + MIN_CLASS));
+        }
+
+        void give_back(int c, void *buffer) {
+            {
+                std::unique_lock<std::mutex> _locker(m_mutex);
+                if (m_free[c].size() < kept(c, GLOBAL_CACHE, GLOBAL_CACHE_BYTES)) {
+                    m_free[c].push_back(buffer);
+                    return;
+                }
+            }
+            ::operator delete(buffer);
+        }
+
+        struct ThreadCache {
+            std::vector<void *> free[CLASSES];
+
+            ~ThreadCache() {
+                for (int c = 0; c < CLASSES; ++c) {
+                    for (auto buffer : free[c]) Global().give_back(c, buffer);
+                }
+            }
+        };
+
+        static ThreadCache &Local() {
+            thread_local ThreadCache cache;
+            return cache;
+        }
+
+        std::mutex m_mutex;
+        std::vector<void *> m_free[CLASSES];
+        std::atomic<uint64_t> m_allocations{0};
+        std::atomic<uint64_t> m_reuses{0};
+    };
+
+    /**
+     * Array of T in pooled buffer, for buffers living within one call
+     */
+    template <typename T>
+    class PooledArray {
+    public:
+        using self = PooledArray;
+
+        explicit PooledArray(size_t size)
+            : m_data(static_cast<T *>(BufferPool::Global().acquire(size * sizeof(T)))), m_size(size) {}
+
+        ~PooledArray() { BufferPool::Global().release(m_data, m_size * sizeof(T)); }
+
+        PooledArray(const self &) = delete;
+        self &operator=(const self &) = delete;
+
+        T *get() const { return m_data; }
+
+        T *data() const { return m_data; }
+
+        size_t size() const { return m_size; }
+
+        T &operator[](size_t i) const { return m_data[i]; }
+
+    private:
+        T *m_data;
+        size_t m_size;
+    };
+}
+
+#endif //SEETA_FACERECOGNIZER_BUFFERPOOL_H
@@ -0,0 +1,175 @@
+#ifndef SEETA_FACERECOGNIZER_DATABASEMETRICS_H
+#define SEETA_FACERECOGNIZER_DATABASEMETRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "Mutex.h"
+#include "Tracer.h"
+
+namespace seeta {
+    /**
+     * Cumulative latency histogram with fixed bounds, in Prometheus layout
+     */
+    class LatencyHistogram {
+    public:
+        using Clock = std::chrono::steady_clock;
+
+        static const int BOUNDS = 14;
+
+        LatencyHistogram() {
+            for (auto &count : m_counts) count = 0;
+        }
+
+        void record(Clock::duration duration) {
+            const auto seconds = std::chrono::duration<double>(duration).count();
+            int bucket = 0;
+            while (bucket < BOUNDS && seconds > Bound(bucket)) ++bucket;
+            m_counts[bucket].fetch_add(1, std::memory_order_relaxed);
+            m_sum_ns.fetch_add(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()), std::memory_order_relaxed);
+        }
+
+        /**
+         * write buckets, sum and count of metric name, labels like `type="top"` or empty
+         */
+        void write(std::ostream &out, const std::string &name, const std::string &labels) const {
+            const auto sep = labels.empty() ? "" : ",";
+            uint64_t cumulative = 0;
+            for (int bucket = 0; bucket <= BOUNDS; ++bucket) {
+                cumulative += m_counts[bucket].load(std::memory_order_relaxed);
+                out << name << "_bucket{" << labels << sep << "le=\"";
+                if (bucket < BOUNDS) out << Bound(bucket);
+                else out << "+Inf";
+                out << "\"} " << cumulative << "\n";
+            }
+            const auto braces = labels.empty() ? std::string() : "{" + labels + "}";
+            out << name << "_sum" << braces << " " << m_sum_ns.load(std::memory_order_relaxed) / 1e9 << "\n";
+            out << name << "_count" << braces << " " << cumulative << "\n";
+        }
+
+    private:
+        /**
+         * 50us to 1s, about 1-2.5-5 per decade
+         */
+        static double Bound(int bucket) {
+            static const double bounds[BOUNDS] = {
+                50e-6, 100e-6, 250e-6, 500e-6, 1e-3, 2.5e-3, 5e-3, 10e-3, 25e-3, 50e-3, 100e-3, 250e-3, 500e-3, 1,
+            };
+            return bounds[bucket];
+        }
+
+        std::atomic<uint64_t> m_counts[BOUNDS + 1];
+        std::atomic<uint64_t> m_sum_ns{0};
+    };
+
+    /**
+     * Counters and histograms of one database, updated lock free from any thread
+     */
+    class DatabaseMetrics {
+    public:
+        using Clock = LatencyHistogram::Clock;
+
+        enum Query {
+            QUERY_TOP = 0,
+            QUERY_TOP_PREFILTER = 1,
+            QUERY_TOP_PARTITION = 2,
+            QUERY_ABOVE = 3,
+            QUERY_ABOVE_ABANDON = 4,
+            QUERY_ABOVE_PARTITION = 5,
+            QUERY_IDENTITIES = 6,
+            QUERY_IDENTITIES_CENTROID = 7,
+            QUERY_MULTI_PROBE = 8,
+            QUERIES = 9,
+        };
+
+        static const char *Name(Query query) {
+            static const char *names[QUERIES] = {
+                "top", "top_prefilter", "top_partition", "above", "above_abandon", "above_partition",
+                "identities", "identities_centroid", "multi_probe",
+            };
+            return names[query];
+        }
+
+        /**
+         * Times one query from construction to destruction, type and rows are set once known
+         */
+        class QueryTimer {
+        public:
+            QueryTimer(DatabaseMetrics &metrics, Query query)
+                : m_metrics(metrics), m_query(query), m_start(Clock::now()) {}
+
+            ~QueryTimer() {
+                const auto end = Clock::now();
+                m_metrics.query_latency[m_query].record(end - m_start);
+                Tracer::Global().record("query", Name(m_query), m_start, end);
+                m_metrics.query_rows[m_query].fetch_add(m_rows, std::memory_order_relaxed);
+            }
+
+            QueryTimer(const QueryTimer &) = delete;
+            QueryTimer &operator=(const QueryTimer &) = delete;
+
+            void set(Query query, uint64_t rows) {
+                m_query = query;
+                m_rows = rows;
+            }
+
+        private:
+            DatabaseMetrics &m_metrics;
+            Query m_query;
+            uint64_t m_rows = 0;
+            Clock::time_point m_start;
+        };
+
+        DatabaseMetrics() {
+            for (auto &rows : query_rows) rows = 0;
+        }
+
+        LatencyHistogram query_latency[QUERIES];
+        std::atomic<uint64_t> query_rows[QUERIES];  ///< rows compared with full features
+        LatencyHistogram insert_latency;
+        LatencyHistogram read_lock_wait;
+        LatencyHistogram write_lock_wait;
+        std::atomic<uint64_t> registrations{0};
+        std::atomic<uint64_t> registration_failures{0};    ///< extraction failed or deadline missed
+    };
+
+    /**
+     * rwmutex timing how long each lock waits into histograms of metrics
+     */
+    class MeteredRwMutex {
+    public:
+        explicit MeteredRwMutex(DatabaseMetrics &metrics) : m_metrics(metrics) {}
+
+        MeteredRwMutex(const MeteredRwMutex &) = delete;
+        MeteredRwMutex &operator=(const MeteredRwMutex &) = delete;
+
+        void lock_read() {
+            const auto start = DatabaseMetrics::Clock::now();
+            m_mutex.lock_read();
+            const auto end = DatabaseMetrics::Clock::now();
+            m_metrics.read_lock_wait.record(end - start);
+            Tracer::Global().record("lock", "read_wait", start, end);
+        }
+
+        void lock_write() {
+            const auto start = DatabaseMetrics::Clock::now();
+            m_mutex.lock_write();
+            const auto end = DatabaseMetrics::Clock::now();
+            m_metrics.write_lock_wait.record(end - start);
+            Tracer::Global().record("lock", "write_wait", start, end);
+        }
+
+        void release_read() { m_mutex.release_read(); }
+
+        void release_write() { m_mutex.release_write(); }
+
+    private:
+        rwmutex m_mutex;
+        DatabaseMetrics &m_metrics;
+    };
+}
+
+#endif //SEETA_FACERECOGNIZER_DATABASEMETRICS_H
@@ -0,0 +1,387 @@
+#ifndef SEETA_FACERECOGNIZER_EXECUTOR_H
+#define SEETA_FACERECOGNIZER_EXECUTOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace seeta {
+    /**
+     * Work-stealing pool shared by all databases of the process.
+     * Each worker pops its own deque from the back and steals from the front of others,
+     * tasks posted from outside go to a shared injection queue.
+     * The number of workers is the thread budget, fixed when the pool is first used.
+     * With NUMA placement, workers are dealt over nodes and pinned to the CPU set of their node,
+     * tasks posted to a node only run there.
+     */
+    class Executor {
+    public:
+        using self = Executor;
+        using Task = std::function<void()>;
+        using CpuSet = std::vector<int>;
+
+        /**
+         * never destroyed, like BufferPool, so late tasks of static objects still have workers
+         */
+        static self &Global() {
+            static self *executor = (Started() = true, new self(Budget(), Placement()));
+            return *executor;
+        }
+
+        /**
+         * @return CPU set of each NUMA node, empty if unknown or not linux
+         */
+        static std::vector<CpuSet> Nodes() {
+            std::vector<CpuSet> nodes;
+#if defined(__linux__)
+            for (int node = 0; ; ++node) {
+                std::ifstream input("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+                if (!input.is_open()) break;
+                std::string list;
+                std::getline(input, list);
+                nodes.push_back(ParseCpuList(list));
+            }
+#endif
+            return nodes;
+        }
+
+        /**
+         * @param enabled pin workers of global executor to NUMA nodes
+         * @return nodes global executor has or will have, 0 if placement is not available, unchanged once it started
+         */
+        static size_t SetPlacement(bool enabled) {
+            if (Started()) return Global().nodes();
+            Placement() = enabled ? Nodes() : std::vector<CpuSet>();
+            return Placement().size();
+        }
+
+        /**
+         * @param threads workers of global executor, 0 for hardware concurrency
+         * @return workers global executor has or will have, unchanged once it started
+         */
+        static size_t SetBudget(size_t threads) {
+            if (Started()) return Global().size();
+            RequestedBudget() = threads;
+            return Budget();
+        }
+
+        /**
+         * @param placement CPU set of each node workers are dealt over, empty for no pinning
+         */
+        explicit Executor(size_t threads, const std::vector<CpuSet> &placement = std::vector<CpuSet>())
+                : m_placement(placement) {
+            threads = std::max<size_t>(1, threads);
+            m_pending_node.reset(new std::atomic<size_t>[nodes()]);
+            for (size_t node = 0; node < nodes(); ++node) m_pending_node[node] = 0;
+            m_injected_node.resize(nodes());
+            for (size_t i = 0; i < threads; ++i) m_queues.emplace_back(new Queue);
+            for (size_t i = 0; i < threads; ++i) m_threads.emplace_back(&self::run, this, i);
+        }
+
+        ~Executor() {
+            {
+                std::unique_lock<std::mutex> _locker(m_mutex);
+                m_stop = true;
+                m_cond.notify_all();
+            }
+            for (auto &thread : m_threads) thread.join();
+        }
+
+        Executor(const self &) = delete;
+        self &operator=(const self &) = delete;
+
+        size_t size() const { return m_threads.size(); }
+
+        size_t nodes() const { return std::max<size_t>(1, m_placement.size()); }
+
+        size_t node_of(size_t worker) const { return worker % nodes(); }
+
+        /**
+         * @return tasks posted and not started yet
+         */
+        size_t pending() const {
+            size_t pending = m_pending;
+            for (size_t node = 0; node < nodes(); ++node) pending += m_pending_node[node];
+            return pending;
+        }
+
+        /**
+         * @param node run only by workers of node % nodes(), negative for any worker
+         */
+        void post(Task task, int node = -1) {
+            // counted before published, a task stolen at once is never uncounted first
+            if (node >= 0) {
+                const auto local = size_t(node) % nodes();
+                ++m_pending_node[local];
+                std::unique_lock<std::mutex> _locker(m_mutex);
+                m_injected_node[local].push_back(std::move(task));
+                m_cond.notify_all();
+                return;
+            }
+            ++m_pending;
+            const auto id = LocalId(this);
+            if (id >= 0) {
+                auto &queue = *m_queues[id];
+                std::unique_lock<std::mutex> _locker(queue.mutex);
+                queue.tasks.push_back(std::move(task));
+            }
+            std::unique_lock<std::mutex> _locker(m_mutex);
+            if (id < 0) m_injected.push_back(std::move(task));
+            m_cond.notify_one();
+        }
+
+        /**
+         * run block(first, second) over [0, count) in at most width blocks, caller runs blocks too,
+         * so it never waits on queued work and may be called from workers
+         */
+        template <typename FUNC>
+        void parallel_for(size_t count, size_t width, FUNC block) {
+            if (count == 0) return;
+            const auto blocks = std::max<size_t>(1, std::min(width, count));
+            if (blocks == 1) {
+                block(size_t(0), count);
+                return;
+            }
+            struct Progress {
+                std::atomic<size_t> next{0};
+                std::mutex mutex;
+                std::condition_variable cond;
+                size_t done = 0;
+            };
+            // helpers starting after all blocks are taken only touch progress
+            auto progress = std::make_shared<Progress>();
+            auto drain = [progress, blocks, count, &block]() {
+                size_t finished = 0;
+                for (auto b = progress->next++; b < blocks; b = progress->next++) {
+                    block(count * b / blocks, count * (b + 1) / blocks);
+                    ++finished;
+                }
+                if (finished == 0) return;
+                std::unique_lock<std::mutex> _locker(progress->mutex);
+                progress->done += finished;
+                if (progress->done == blocks) progress->cond.notify_all();
+            };
+            for (size_t i = 1; i < blocks; ++i) post(drain);
+            drain();
+            std::unique_lock<std::mutex> _locker(progress->mutex);
+            progress->cond.wait(_locker, [&]() { return progress->done == blocks; });
+        }
+
+        /**
+         * Serial queue over executor, tasks run one at a time in order of posting
+         */
+        class Strand {
+        public:
+            explicit Strand(Executor &executor = Executor::Global()) : m_executor(executor) {}
+
+            ~Strand() { join(); }
+
+            Strand(const Strand &) = delete;
+            Strand &operator=(const Strand &) = delete;
+
+            template <typename FUNC>
+            void operator()(FUNC func) const {
+                std::unique_lock<std::mutex> _locker(m_mutex);
+                m_tasks.push_back(Task(func));
+                if (m_running) return;
+                m_running = true;
+                m_executor.post([this]() { drain(); });
+            }
+
+            void join() const {
+                std::unique_lock<std::mutex> _locker(m_mutex);
+                m_cond.wait(_locker, [this]() { return !m_running; });
+            }
+
+            /**
+             * @return tasks queued and not started yet
+             */
+            size_t size() const {
+                std::unique_lock<std::mutex> _locker(m_mutex);
+                return m_tasks.size();
+            }
+
+        private:
+            void drain() const {
+                std::unique_lock<std::mutex> _locker(m_mutex);
+                while (!m_tasks.empty()) {
+                    auto task = std::move(m_tasks.front());
+                    m_tasks.pop_front();
+                    _locker.unlock();
+                    task();
+                    _locker.lock();
+                }
+                m_running = false;
+                m_cond.notify_all();
+            }
+
+            Executor &m_executor;
+            mutable std::mutex m_mutex;
+            mutable std::condition_variable m_cond;
+            mutable std::deque<Task> m_tasks;
+            mutable bool m_running = false;
+        };
+
+    private:
+        struct Queue {
+            std::mutex mutex;
+            std::deque<Task> tasks;
+        };
+
+        static bool &Started() {
+            static bool started = false;
+            return started;
+        }
+
+        static size_t &RequestedBudget() {
+            static size_t threads = 0;
+            return threads;
+        }
+
+        static std::vector<CpuSet> &Placement() {
+            static std::vector<CpuSet> nodes;
+            return nodes;
+        }
+
+        /**
+         * parse cpulist of sysfs, like "0-7,16-23"
+         */
+        static CpuSet ParseCpuList(const std::string &list) {
+            CpuSet cpus;
+            std::stringstream ranges(list);
+            std::string range;
+            while (std::getline(ranges, range, ',')) {
+                if (range.empty()) continue;
+                const auto dash = range.find('-');
+                const auto first = std::atoi(range.substr(0, dash).c_str());
+                const auto last = dash == std::string::npos ? first : std::atoi(range.substr(dash + 1).c_str());
+                for (auto cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+            }
+            return cpus;
+        }
+
+        /**
+         * pin calling thread to cpus, threads it starts later inherit the set
+         */
+        static bool Pin(const CpuSet &cpus) {
+#if defined(__linux__)
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            for (auto cpu : cpus) if (cpu >= 0 && cpu < CPU_SETSIZE) CPU_SET(cpu, &set);
+            return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+            (void)(cpus);
+            return false;
+#endif
+        }
+
+        static size_t Budget() {
+            if (RequestedBudget() > 0) return RequestedBudget();
+            return std::max<size_t>(1, std::thread::hardware_concurrency());
+        }
+
+        /**
+         * @return id of calling thread in executor, -1 if it is not a worker of executor
+         */
+        static int LocalId(const self *executor, int id = -2) {
+            thread_local const self *owner = nullptr;
+            thread_local int local = -1;
+            if (id >= -1) {
+                owner = executor;
+                local = id;
+            }
+            return owner == executor ? local : -1;
+        }
+
+        bool take(size_t id, Task &task) {
+            const auto node = node_of(id);
+            {
+                std::unique_lock<std::mutex> _locker(m_mutex);
+                auto &injected = m_injected_node[node];
+                if (!injected.empty()) {
+                    task = std::move(injected.front());
+                    injected.pop_front();
+                    --m_pending_node[node];
+                    return true;
+                }
+            }
+            {
+                auto &queue = *m_queues[id];
+                std::unique_lock<std::mutex> _locker(queue.mutex);
+                if (!queue.tasks.empty()) {
+                    task = std::move(queue.tasks.back());
+                    queue.tasks.pop_back();
+                    --m_pending;
+                    return true;
+                }
+            }
+            {
+                std::unique_lock<std::mutex> _locker(m_mutex);
+                if (!m_injected.empty()) {
+                    task = std::move(m_injected.front());
+                    m_injected.pop_front();
+                    --m_pending;
+                    return true;
+                }
+            }
+            for (size_t i = 1; i < m_queues.size(); ++i) {
+                auto &victim = *m_queues[(id + i) % m_queues.size()];
+                std::unique_lock<std::mutex> _locker(victim.mutex);
+                if (!victim.tasks.empty()) {
+                    task = std::move(victim.tasks.front());
+                    victim.tasks.pop_front();
+                    --m_pending;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        void run(size_t id) {
+            LocalId(this, int(id));
+            const auto node = node_of(id);
+            if (!m_placement.empty()) Pin(m_placement[node]);
+            Task task;
+            while (true) {
+                {
+                    std::unique_lock<std::mutex> _locker(m_mutex);
+                    m_cond.wait(_locker, [&]() { return m_stop || m_pending > 0 || m_pending_node[node] > 0; });
+                    if (m_stop) return;
+                }
+                if (!take(id, task)) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                task();
+                task = nullptr;
+            }
+        }
+
+        std::vector<std::unique_ptr<Queue>> m_queues;
+        std::vector<std::thread> m_threads;
+        std::mutex m_mutex;
+        std::condition_variable m_cond;
+        std::vector<CpuSet> m_placement;
+        std::deque<Task> m_injected;
+        std::vector<std::deque<Task>> m_injected_node;  ///< tasks bound to each node
+        std::atomic<size_t> m_pending{0};   ///< unbound tasks
+        std::unique_ptr<std::atomic<size_t>[]> m_pending_node;  ///< bound tasks of each node
+        bool m_stop = false;
+    };
+}
+
+#endif //SEETA_FACERECOGNIZER_EXECUTOR_H
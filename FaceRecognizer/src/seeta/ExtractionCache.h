@@ -0,0 +1,169 @@
+#ifndef SEETA_FACERECOGNIZER_EXTRACTIONCACHE_H
+#define SEETA_FACERECOGNIZER_EXTRACTIONCACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace seeta {
+    /**
+     * 64-bit xxHash (XXH64) of bytes
+     */
+    inline uint64_t hash64(const void *data, size_t size, uint64_t seed = 0) {
+        static const uint64_t P1 = 11400714785074694791ULL;
+        static const uint64_t P2 = 14029467366897019727ULL;
+        static const uint64_t P3 = 1609587929392839161ULL;
+        static const uint64_t P4 = 9650029242287828579ULL;
+        static const uint64_t P5 = 2870177450012600261ULL;
+        auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+        auto read64 = [](const uint8_t *p) { uint64_t v; std::memcpy(&v, p, 8); return v; };
+        auto read32 = [](const uint8_t *p) { uint32_t v; std::memcpy(&v, p, 4); return v; };
+        auto round = [&](uint64_t acc, uint64_t lane) { return rotl(acc + lane * P2, 31) * P1; };
+        auto merge = [&](uint64_t acc, uint64_t value) { return (acc ^ round(0, value)) * P1 + P4; };
+
+        auto p = static_cast<const uint8_t *>(data);
+        const auto end = p + size;
+        uint64_t h;
+        if (size >= 32) {
+            uint64_t v1 = seed + P1 + P2, v2 = seed + P2, v3 = seed, v4 = seed - P1;
+            for (; end - p >= 32; p += 32) {
+                v1 = round(v1, read64(p));
+                v2 = round(v2, read64(p + 8));
+                v3 = round(v3, read64(p + 16));
+                v4 = round(v4, read64(p + 24));
+            }
+            h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            h = merge(h, v1);
+            h = merge(h, v2);
+            h = merge(h, v3);
+            h = merge(h, v4);
+        } else {
+            h = seed + P5;
+        }
+        h += uint64_t(size);
+        for (; end - p >= 8; p += 8) h = rotl(h ^ round(0, read64(p)), 27) * P1 + P4;
+        if (end - p >= 4) {
+            h = rotl(h ^ (uint64_t(read32(p)) * P1), 23) * P2 + P3;
+            p += 4;
+        }
+        for (; p < end; ++p) h = rotl(h ^ (uint64_t(*p) * P5), 11) * P1;
+        h ^= h >> 33;
+        h *= P2;
+        h ^= h >> 29;
+        h *= P3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    /**
+     * Bounded LRU of extracted features, keyed by hash of cropped face and model fingerprint.
+     * Each entry keeps its crop bytes too, a hit is only taken if they match, so colliding keys never return other faces' features.
+     * Keys are spread over SHARDS independently locked shards, capacity 0 disables the cache.
+     */
+    class ExtractionCache {
+    public:
+        using self = ExtractionCache;
+        using shared = std::shared_ptr<self>;
+
+        static const size_t SHARDS = 16;
+
+        explicit ExtractionCache(size_t feature_size) : m_feature_size(feature_size) {}
+
+        bool enabled() const { return m_capacity.load(std::memory_order_relaxed) > 0; }
+
+        size_t capacity() const { return m_capacity; }
+
+        void resize(size_t capacity) {
+            m_capacity = capacity;
+            const auto per_shard = (capacity + SHARDS - 1) / SHARDS;
+            for (auto &shard : m_shards) {
+                std::unique_lock<std::mutex> _locker(shard.mutex);
+                shard.capacity = per_shard;
+                shard.evict();
+            }
+        }
+
+        /**
+         * @param crop bytes of cropped face hashed into key
+         * @return true if hit, features are copied out
+         */
+        bool find(uint64_t key, const uint8_t *crop, size_t size, float *features) const {
+            auto &shard = m_shards[key % SHARDS];
+            std::unique_lock<std::mutex> _locker(shard.mutex);
+            auto it = shard.lookup.find(key);
+            if (it == shard.lookup.end() || !it->second->matches(crop, size)) {
+                ++m_misses;
+                return false;
+            }
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+            std::memcpy(features, it->second->features.data(), m_feature_size * sizeof(float));
+            ++m_hits;
+            return true;
+        }
+
+        /**
+         * entry of colliding key with other crop is replaced
+         */
+        void insert(uint64_t key, const uint8_t *crop, size_t size, const float *features) const {
+            auto &shard = m_shards[key % SHARDS];
+            std::unique_lock<std::mutex> _locker(shard.mutex);
+            if (shard.capacity == 0) return;
+            auto it = shard.lookup.find(key);
+            if (it != shard.lookup.end()) {
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                if (it->second->matches(crop, size)) return;
+                shard.lru.front().crop.assign(crop, crop + size);
+                shard.lru.front().features.assign(features, features + m_feature_size);
+                return;
+            }
+            shard.lru.emplace_front();
+            shard.lru.front().key = key;
+            shard.lru.front().crop.assign(crop, crop + size);
+            shard.lru.front().features.assign(features, features + m_feature_size);
+            shard.lookup[key] = shard.lru.begin();
+            shard.evict();
+        }
+
+        uint64_t hits() const { return m_hits; }
+
+        uint64_t misses() const { return m_misses; }
+
+    private:
+        struct Entry {
+            uint64_t key = 0;
+            std::vector<uint8_t> crop;
+            std::vector<float> features;
+
+            bool matches(const uint8_t *data, size_t size) const {
+                return crop.size() == size && std::memcmp(crop.data(), data, size) == 0;
+            }
+        };
+
+        struct Shard {
+            std::mutex mutex;
+            size_t capacity = 0;
+            std::list<Entry> lru;   ///< most recently used first
+            std::unordered_map<uint64_t, std::list<Entry>::iterator> lookup;
+
+            void evict() {
+                while (lru.size() > capacity) {
+                    lookup.erase(lru.back().key);
+                    lru.pop_back();
+                }
+            }
+        };
+
+        size_t m_feature_size;
+        std::atomic<size_t> m_capacity{0};
+        mutable Shard m_shards[SHARDS];
+        mutable std::atomic<uint64_t> m_hits{0};
+        mutable std::atomic<uint64_t> m_misses{0};
+    };
+}
+
+#endif //SEETA_FACERECOGNIZER_EXTRACTIONCACHE_H
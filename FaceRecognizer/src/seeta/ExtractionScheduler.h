@@ -0,0 +1,236 @@
+#ifndef SEETA_FACERECOGNIZER_EXTRACTIONSCHEDULER_H
+#define SEETA_FACERECOGNIZER_EXTRACTIONSCHEDULER_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Executor.h"
+#include "Tracer.h"
+
+namespace seeta {
+    /**
+     * Extraction cores fed by two priority classes, run as tasks of the shared executor, core i on node i of executor.
+     * Interactive tasks always go first, the first `reserved` cores never take bulk tasks,
+     * bulk tasks past their deadline are dropped instead of run, and bulk submission blocks once its queue is full.
+     */
+    class ExtractionScheduler {
+    public:
+        using self = ExtractionScheduler;
+        using Clock = std::chrono::steady_clock;
+
+        enum Priority {
+            INTERACTIVE = 0,
+            BULK = 1,
+        };
+
+        /**
+         * Handle of one submitted task
+         */
+        class Ticket {
+        public:
+            void join() const {
+                std::unique_lock<std::mutex> _locker(m_mutex);
+                m_cond.wait(_locker, [this]() { return m_done; });
+            }
+
+        private:
+            friend class ExtractionScheduler;
+
+            void done() {
+                std::unique_lock<std::mutex> _locker(m_mutex);
+                m_done = true;
+                m_cond.notify_all();
+            }
+
+            mutable std::mutex m_mutex;
+            mutable std::condition_variable m_cond;
+            bool m_done = false;
+        };
+
+        /**
+         * @param cores tasks run with core id in [0, cores), one task per core at a time
+         * @param reserved cores only running interactive tasks, at most cores - 1
+         * @param bulk_capacity queued bulk tasks before submit blocks
+         */
+        ExtractionScheduler(Executor &executor, int cores, int reserved, size_t bulk_capacity)
+                : m_executor(executor), m_bulk_capacity(bulk_capacity) {
+            m_free.assign(size_t(std::max(1, cores)), true);
+            reserve(reserved, int(m_free.size()));
+        }
+
+        /**
+         * queued tasks are finished or dropped by deadline first
+         */
+        ~ExtractionScheduler() {
+            join();
+        }
+
+        ExtractionScheduler(const self &) = delete;
+        self &operator=(const self &) = delete;
+
+        size_t size() const { return m_free.size(); }
+
+        int reserved() const {
+            std::unique_lock<std::mutex> _locker(m_mutex);
+            return m_reserved;
+        }
+
+        void reserve(int reserved) {
+            std::unique_lock<std::mutex> _locker(m_mutex);
+            reserve(reserved, int(m_free.size()));
+            dispatch();
+        }
+
+        /**
+         * change number of cores once all tasks are finished, reserved cores are clamped to new size
+         */
+        void resize(int cores, size_t bulk_capacity) {
+            std::unique_lock<std::mutex> _locker(m_mutex);
+            m_idle_cond.wait(_locker, [this]() { return idle(INTERACTIVE) && idle(BULK); });
+            m_free.assign(size_t(std::max(1, cores)), true);
+            m_bulk_capacity = bulk_capacity;
+            reserve(m_reserved, int(m_free.size()));
+            m_space_cond.notify_all();
+        }
+
+        /**
+         * @param task called with core id
+         * @param expired called instead of task if deadline passed before task started
+         */
+        std::shared_ptr<Ticket> submit(Priority priority, std::function<void(int)> task,
+                                       std::function<void()> expired = nullptr,
+                                       Clock::time_point deadline = Clock::time_point::max()) {
+            auto ticket = std::make_shared<Ticket>();
+            std::unique_lock<std::mutex> _locker(m_mutex);
+            auto &queue = m_queues[priority];
+            if (priority == BULK) {
+                m_space_cond.wait(_locker, [&]() { return queue.size() < m_bulk_capacity; });
+            }
+            queue.push_back(Task{std::move(task), std::move(expired), deadline, ticket, Clock::now()});
+            dispatch();
+            return ticket;
+        }
+
+        /**
+         * wait until all tasks of priority are finished or dropped
+         */
+        void join(Priority priority) const {
+            std::unique_lock<std::mutex> _locker(m_mutex);
+            m_idle_cond.wait(_locker, [&]() { return idle(priority); });
+        }
+
+        void join() const {
+            join(INTERACTIVE);
+            join(BULK);
+        }
+
+        uint64_t expired() const {
+            std::unique_lock<std::mutex> _locker(m_mutex);
+            return m_expired;
+        }
+
+        size_t queued(Priority priority) const {
+            std::unique_lock<std::mutex> _locker(m_mutex);
+            return m_queues[priority].size();
+        }
+
+        size_t running(Priority priority) const {
+            std::unique_lock<std::mutex> _locker(m_mutex);
+            return size_t(m_running[priority]);
+        }
+
+    private:
+        struct Task {
+            std::function<void(int)> run;
+            std::function<void()> expired;
+            Clock::time_point deadline;
+            std::shared_ptr<Ticket> ticket;
+            Clock::time_point queued;
+        };
+
+        bool idle(Priority priority) const {
+            return m_queues[priority].empty() && m_running[priority] == 0;
+        }
+
+        void reserve(int reserved, int cores) {
+            m_reserved = std::max(0, std::min(reserved, cores - 1));
+        }
+
+        /**
+         * @return free core for priority, -1 for none; interactive tasks take reserved cores first
+         */
+        int pick(Priority priority) const {
+            const auto cores = int(m_free.size());
+            if (priority == INTERACTIVE) {
+                for (int id = 0; id < cores; ++id) if (m_free[id]) return id;
+                return -1;
+            }
+            for (int id = cores - 1; id >= m_reserved; --id) if (m_free[id]) return id;
+            return -1;
+        }
+
+        /**
+         * hand queued tasks to executor while their cores are free, locked by caller
+         */
+        void dispatch() {
+            while (true) {
+                auto priority = INTERACTIVE;
+                auto core = m_queues[INTERACTIVE].empty() ? -1 : pick(INTERACTIVE);
+                if (core < 0) {
+                    priority = BULK;
+                    core = m_queues[BULK].empty() ? -1 : pick(BULK);
+                }
+                if (core < 0) return;
+                auto task = std::move(m_queues[priority].front());
+                m_queues[priority].pop_front();
+                if (priority == BULK) m_space_cond.notify_one();
+                m_free[core] = false;
+                ++m_running[priority];
+                auto shared_task = std::make_shared<Task>(std::move(task));
+                // core i stays on node i, where its workspace was first touched
+                m_executor.post([this, core, priority, shared_task]() { execute(core, priority, *shared_task); }, core);
+            }
+        }
+
+        void execute(int core, Priority priority, Task &task) {
+            const auto now = Clock::now();
+            Tracer::Global().record("extraction", "enqueue", task.queued, now);
+            if (now > task.deadline) {
+                {
+                    std::unique_lock<std::mutex> _locker(m_mutex);
+                    ++m_expired;
+                }
+                if (task.expired) task.expired();
+            } else {
+                task.run(core);
+            }
+            task.ticket->done();
+
+            std::unique_lock<std::mutex> _locker(m_mutex);
+            m_free[core] = true;
+            --m_running[priority];
+            m_idle_cond.notify_all();
+            dispatch();
+        }
+
+        Executor &m_executor;
+        size_t m_bulk_capacity;
+        std::vector<bool> m_free;   ///< free state of each core
+        int m_reserved = 0;
+        std::deque<Task> m_queues[2];
+        int m_running[2] = {0, 0};
+        uint64_t m_expired = 0;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_space_cond;
+        mutable std::condition_variable m_idle_cond;
+    };
+}
+
+#endif //SEETA_FACERECOGNIZER_EXTRACTIONSCHEDULER_H
@@ -6,8 +6,9 @@
 #include "FaceAlignment.h"
 
 #include "transform.h"
+#include "YUVWarp.h"
 
-#include "api/cpp/intime.h"
+#include <cstring>
 #include <map>
 
 
@@ -90,6 +91,8 @@ namespace seeta {
         }
         m_data = new Data;
         m_mode_string = mode;
+        // mean shapes are cached before any crop, so concurrent crops only read them
+        if (m_mode == MULTI) m_data->get_mean_shape_group(m_final_width);
     }
 
     FaceAlignment::~FaceAlignment() {
@@ -105,19 +108,31 @@ namespace seeta {
     }
 
     void FaceAlignment::crop_face(const SeetaImageData &image, const SeetaPointF *points, SeetaImageData &face) const {
+        float M[9];
+        matrix(points, M);
+        packed_affine_sample(image, M, face.data, m_final_width, m_final_height);
+    }
+
+    void FaceAlignment::crop_face(const FaceRecognizer::YUVImageData &image, const SeetaPointF *points, SeetaImageData &face) const {
+        float M[9];
+        matrix(points, M);
+        yuv_affine_sample(image, M, face.data, m_final_width, m_final_height);
+    }
+
+    void FaceAlignment::matrix(const SeetaPointF *points, float *M) const {
         if (m_mode == SINGLE) {
-            crop_single(image, points, face);
+            matrix_single(points, M);
         } else if (m_mode == MULTI) {
-            crop_multi(image, points, face);
+            matrix_multi(points, M);
         } else if (m_mode == ARCFACE) {
-            crop_arcface(image, points, face);
+            matrix_arcface(points, M);
         } else {
-            crop_single(image, points, face);
+            matrix_single(points, M);
         }
     }
 
     void
-    FaceAlignment::crop_single(const SeetaImageData &image, const SeetaPointF *points, SeetaImageData &face) const {
+    FaceAlignment::matrix_single(const SeetaPointF *points, float *M) const {
         // parameters will be safe by caller
         std::vector<ts::Vec2D<float>> mean_shape = {
                 {89.3095f,  72.9025f},
@@ -136,19 +151,10 @@ namespace seeta {
                 {float(points[4].x), float(points[4].y)},
         };
 
-        auto M = transform2d(landmarks, mean_shape);
+        auto trans = transform2d(landmarks, mean_shape);
         auto shift = ts::affine::translate<float>(-float(m_final_width - width) / 2, -float(m_final_height - height) / 2);
-        ts::stack(shift, M);
-        M = shift;
-
-        auto tensor_image = ts::api::tensor::build(TS_UINT8, {image.height, image.width, image.channels}, image.data);
-        auto tensor_affine = ts::api::tensor::build(TS_FLOAT32, {3, 3}, M.data());
-
-        auto tensor_patch = ts::api::intime::affine_sample2d(tensor_image, {m_final_height, m_final_width},
-                                                             tensor_affine, 0, 0, ts::api::intime::ResizeMethod::BILINEAR);
-        tensor_patch.sync_cpu();
-
-        memcpy(face.data, tensor_patch.data(), tensor_patch.count());
+        ts::stack(shift, trans);
+        std::memcpy(M, shift.data(), 9 * sizeof(float));
     }
 
     static float operator^(const ts::Vec2D<float> &lhs, const ts::Vec2D<float> &rhs) {
@@ -157,7 +163,7 @@ namespace seeta {
         return std::sqrt(dx * dx + dy * dy);
     }
 
-    void FaceAlignment::crop_multi(const SeetaImageData &image, const SeetaPointF *points, SeetaImageData &face) const {
+    void FaceAlignment::matrix_multi(const SeetaPointF *points, float *M) const {
         SimilarityTransform2D transform;
         std::vector<ts::Vec2D<float>> landmarks = {
                 {float(points[0].x), float(points[0].y)},
@@ -174,10 +180,10 @@ namespace seeta {
         for (size_t i = 0; i < src.size(); ++i) {
             auto &meanshape = src[i];
             transform.estimate(landmarks, meanshape);
-            auto M = transform.params;
+            auto trans = transform.params;
             std::vector<ts::Vec2D<float>> results(landmarks.size());
             for (size_t j = 0; j < results.size(); ++j) {
-                results[j] = ts::transform(M, landmarks[j]);
+                results[j] = ts::transform(trans, landmarks[j]);
             }
             float local_error = 0;
             for (size_t j = 0; j < results.size(); ++j) {
@@ -185,23 +191,14 @@ namespace seeta {
             }
             if (local_error < min_error) {
                 min_error = local_error;
-                min_M = M;
+                min_M = trans;
             }
         }
-        auto M = min_M;
-        M = ts::affine::inverse(M);
-
-        auto tensor_image = ts::api::tensor::build(TS_UINT8, {image.height, image.width, image.channels}, image.data);
-        auto tensor_affine = ts::api::tensor::build(TS_FLOAT32, {3, 3}, M.data());
-
-        auto tensor_patch = ts::api::intime::affine_sample2d(tensor_image, {m_final_height, m_final_width},
-                                                             tensor_affine, 0, 0, ts::api::intime::ResizeMethod::BILINEAR);
-        tensor_patch.sync_cpu();
-
-        memcpy(face.data, tensor_patch.data(), tensor_patch.count());
+        auto inverse = ts::affine::inverse(min_M);
+        std::memcpy(M, inverse.data(), 9 * sizeof(float));
     }
     void
-    FaceAlignment::crop_arcface(const SeetaImageData &image, const SeetaPointF *points, SeetaImageData &face) const {
+    FaceAlignment::matrix_arcface(const SeetaPointF *points, float *M) const {
         // parameters will be safe by caller
         std::vector<ts::Vec2D<float>> mean_shape = {
                 {38.2946f, 51.6963f},
@@ -219,15 +216,7 @@ namespace seeta {
                 {float(points[4].x), float(points[4].y)},
         };
 
-        auto M = transform2d(landmarks, mean_shape);
-
-        auto tensor_image = ts::api::tensor::build(TS_UINT8, {image.height, image.width, image.channels}, image.data);
-        auto tensor_affine = ts::api::tensor::build(TS_FLOAT32, {3, 3}, M.data());
-
-        auto tensor_patch = ts::api::intime::affine_sample2d(tensor_image, {m_final_height, m_final_width},
-                                                             tensor_affine, 0, 0, ts::api::intime::ResizeMethod::BILINEAR);
-        tensor_patch.sync_cpu();
-
-        memcpy(face.data, tensor_patch.data(), tensor_patch.count());
+        auto trans = transform2d(landmarks, mean_shape);
+        std::memcpy(M, trans.data(), 9 * sizeof(float));
     }
 }
\ No newline at end of file
@@ -36,18 +36,31 @@ namespace seeta {
 
         int crop_height() const;
 
+        /**
+         * crop without compute context, safe to call from many threads at once
+         */
         void crop_face(const SeetaImageData &image, const SeetaPointF *points, SeetaImageData &face) const;
 
+        /**
+         * sample planes and convert to BGR per output pixel, face must have 3 channels
+         */
+        void crop_face(const FaceRecognizer::YUVImageData &image, const SeetaPointF *points, SeetaImageData &face) const;
+
+        /**
+         * @param M [out] 3x3 row-major affine mapping crop pixel to image position
+         */
+        void matrix(const SeetaPointF *points, float *M) const;
+
         shared clone() const {
             return std::make_shared<FaceAlignment>(m_mode_string, m_final_width, m_final_height, m_n);
         }
 
     private:
-        void crop_single(const SeetaImageData &image, const SeetaPointF *points, SeetaImageData &face) const;
+        void matrix_single(const SeetaPointF *points, float *M) const;
 
-        void crop_multi(const SeetaImageData &image, const SeetaPointF *points, SeetaImageData &face) const;
+        void matrix_multi(const SeetaPointF *points, float *M) const;
 
-        void crop_arcface(const SeetaImageData &image, const SeetaPointF *points, SeetaImageData &face) const;
+        void matrix_arcface(const SeetaPointF *points, float *M) const;
 
     private:
         std::string m_mode_string;
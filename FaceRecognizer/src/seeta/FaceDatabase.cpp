@@ -6,12 +6,25 @@
 #include <array>
 #include <cmath>
 #include <fstream>
-#include <orz/sync/shotgun.h>
 #include <map>
-#include <orz/sync/canyon.h>
 #include "Mutex.h"
 #include <stack>
 #include "seeta/common_alignment.h"
+#include "Kernels.h"
+#include "PCA.h"
+#include "SlotSet.h"
+#include "BufferPool.h"
+#include "Executor.h"
+#include "ExtractionScheduler.h"
+#include "DatabaseMetrics.h"
+#include "ExtractionCache.h"
+#include "Tracer.h"
+#include <cfloat>
+#include <functional>
+#include <future>
+#include <random>
+#include <sstream>
+#include <thread>
 
 #define VER_HEAD(x) #x "."
 #define VER_TAIL(x) #x
@@ -50,47 +63,205 @@ namespace seeta
 
 				std::string model_filename = models[0];
 
-                m_cores.resize(extraction_core_number);
-                for (auto &core : m_cores)
+                // cores are cloned from the first one, so they share its extraction cache
+                m_cores.push_back(std::make_shared<seeta::FaceRecognizer>(exciting));
+                CloneCores(size_t(extraction_core_number));
+                m_main_core = m_cores[0];
+                Setup(size_t(m_main_core->GetExtractFeatureSize()), extraction_core_number, comparation_core_number);
+			}
+
+            /**
+             * \brief model-free database, rows are given as features and compared by inner product
+             */
+            Implement(int feature_size, int comparation_core_number)
+            {
+                m_kernel = kernel::FeatureKernel::Select(feature_size);
+                Setup(size_t(feature_size), 1, comparation_core_number);
+            }
+
+            void Setup(size_t dim, int extraction_core_number, int comparation_core_number)
+            {
+                m_dim = dim;
+                m_signature_words = (m_dim + 63) / 64;
+                m_tail_blocks = (m_dim + ABANDON_BLOCK - 1) / ABANDON_BLOCK;
+
+                m_extraction_scheduler.reset(new ExtractionScheduler(m_executor, extraction_core_number,
+                    ReservedCores(extraction_core_number), size_t(extraction_core_number) * BULK_QUEUE_PER_CORE));
+                m_comparation_width = size_t(std::max(1, comparation_core_number));
+            }
+
+            /**
+             * \brief one in RESERVED_CORE_RATIO extraction cores, and at least one as soon as there are two
+             */
+            static int ReservedCores(int cores)
+            {
+                return cores > 1 ? std::max(1, cores / RESERVED_CORE_RATIO) : 0;
+            }
+
+            /**
+             * \brief clone cores up to count from the first one, with NUMA placement each clone is made on node of its core
+             */
+            void CloneCores(size_t count)
+            {
+                const auto first = m_cores.size();
+                m_cores.resize(count);
+                if (m_executor.nodes() < 2)
                 {
-                    core = std::make_shared<seeta::FaceRecognizer>(exciting);
+                    for (auto i = first; i < count; ++i) m_cores[i] = std::make_shared<seeta::FaceRecognizer>(m_cores[0].get());
+                    return;
                 }
-                m_main_core = m_cores[0];
+                // one at a time, clones read the first core
+                for (auto i = first; i < count; ++i)
+                {
+                    auto done = std::make_shared<std::promise<void>>();
+                    auto cloned = done->get_future();
+                    m_executor.post([this, i, done]()
+                    {
+                        m_cores[i] = std::make_shared<seeta::FaceRecognizer>(m_cores[0].get());
+                        done->set_value();
+                    }, int(i));
+                    cloned.wait();
+                }
+            }
 
-                m_extraction_gun.reset(new orz::Shotgun(extraction_core_number));
-                m_comparation_gun.reset(new orz::Shotgun(comparation_core_number > 1 ? comparation_core_number : 0));
-			}
+            ~Implement()
+            {
+                // drain in pipeline order, extractions feed insertions, insertions feed alerts
+                m_extraction_scheduler.reset();
+                JoinInsertion();
+                m_alert_queue.join();
+            }
 
-            seeta::FaceRecognizer &core() { return *m_main_core; }
-            const seeta::FaceRecognizer &core() const { return *m_main_core; }
+            using Ticket = std::shared_ptr<ExtractionScheduler::Ticket>;
 
-            size_t extraction_core_number() const { return m_extraction_gun->size(); }
-            size_t comparation_core_number() const { return m_comparation_gun->size(); }
+            size_t dim() const { return m_dim; }
 
-            orz::Cartridge *ExtractParallel(const SeetaImageData &image, const SeetaPointF *points, float *features) const
+            /**
+             * \brief log and return false for model-free database
+             */
+            bool HasModel() const
             {
-                if (!points || !features) return nullptr;
-                seeta::ImageData local_image = image;
-                std::vector<SeetaPointF> local_points(points, points + 5);
-                return m_extraction_gun->fire([this, local_image, local_points, features](int id)
+                if (m_main_core != nullptr) return true;
+                orz::Log(orz::ERROR) << LOG_HEAD << "No model loaded, only features can be registered and queried";
+                return false;
+            }
+
+            float Similarity(const float *lhs, const float *rhs) const
+            {
+                if (m_main_core != nullptr) return m_main_core->CalculateSimilarity(lhs, rhs);
+                return m_kernel.dot(lhs, rhs, int(m_dim));
+            }
+
+            void SimilarityMany(const float *features, const float *rows, size_t stride, size_t N, float *similarity) const
+            {
+                if (m_main_core != nullptr)
                 {
-                    m_cores[id]->Extract(local_image, local_points.data(), features);
-                });
+                    m_main_core->CalculateSimilarityMany(features, rows, stride, N, similarity);
+                    return;
+                }
+                m_kernel.dot_many(features, rows, stride, N, int(m_dim), similarity);
+            }
+
+            /**
+             * \brief inner product a row must reach for similarity, -FLT_MAX if similarity is not monotonic in it
+             */
+            float InnerProductThreshold(float similarity) const
+            {
+                if (m_main_core != nullptr) return m_main_core->GetInnerProductThreshold(similarity);
+                return similarity;
+            }
+
+            /**
+             * \brief map inner products to similarity in place, only valid when InnerProductThreshold is bounded
+             */
+            void SimilarityFromInnerProduct(float *values, size_t N) const
+            {
+                if (m_main_core != nullptr) m_main_core->CalculateSimilarityFromInnerProduct(values, N, values);
             }
 
-            orz::Cartridge *ExtractCroppedFaceParallel(const SeetaImageData &image, float *features) const
+            size_t extraction_core_number() const { return m_extraction_scheduler->size(); }
+            size_t comparation_core_number() const { return m_comparation_width; }
+
+            /**
+             * \brief image handed to workers, pixels are kept alive by owner
+             */
+            class SharedImage
             {
-                if (!features) return nullptr;
-                seeta::ImageData local_image = image;
-                return m_extraction_gun->fire([this, local_image, features](int id)
+            public:
+                /**
+                 * \brief deep copy into pooled buffer, caller may reuse its buffer
+                 */
+                SharedImage(const SeetaImageData &image)
+                    : view(image)
                 {
-                    m_cores[id]->ExtractCroppedFace(local_image, features);
-                });
+                    auto pixels = BufferPool::Global().shared<unsigned char>(size_t(image.width) * image.height * image.channels);
+                    std::memcpy(pixels.get(), image.data, size_t(image.width) * image.height * image.channels);
+                    view.data = pixels.get();
+                    owner = pixels;
+                }
+
+                /**
+                 * \brief shared without copy
+                 */
+                SharedImage(const seeta::ImageData &image)
+                    : owner(std::make_shared<seeta::ImageData>(image)), view(image) {}
+
+                /**
+                 * \brief empty, no buffer is taken
+                 */
+                SharedImage()
+                    : view({ 0, 0, 0, nullptr }) {}
+
+                SharedImage(int width, int height, int channels)
+                    : view({ width, height, channels, nullptr })
+                {
+                    auto pixels = BufferPool::Global().shared<unsigned char>(size_t(width) * height * channels);
+                    view.data = pixels.get();
+                    owner = pixels;
+                }
+
+                std::shared_ptr<void> owner;
+                SeetaImageData view;
+            };
+
+            /**
+             * \brief crop face on caller thread into pooled buffer, so only the crop crosses threads instead of the whole frame
+             */
+            bool CropFace(const SeetaImageData &image, const SeetaPointF *points, SharedImage &face) const
+            {
+                if (!HasModel()) return false;
+                face = SharedImage(m_main_core->GetCropFaceWidthV2(), m_main_core->GetCropFaceHeightV2(), m_main_core->GetCropFaceChannelsV2());
+                // cropping needs no compute context, so callers crop on the main core at once
+                return m_main_core->CropFaceV2(image, points, face.view);
+            }
+
+            /**
+             * \brief submit extraction, tasks index m_cores, so cores are never replaced between submission and join of Configure
+             */
+            Ticket Submit(ExtractionScheduler::Priority priority, std::function<void(int)> task,
+                std::function<void()> expired = nullptr,
+                ExtractionScheduler::Clock::time_point deadline = ExtractionScheduler::Clock::time_point::max()) const
+            {
+                unique_read_lock<rwmutex> _locker(m_cores_mutex);
+                return m_extraction_scheduler->submit(priority, std::move(task), std::move(expired), deadline);
             }
 
-            void JoinExtraction() const
+            Ticket ExtractParallel(const SeetaImageData &image, const SeetaPointF *points, float *features) const
             {
-                m_extraction_gun->join();
+                if (!points || !features) return nullptr;
+                SharedImage face;
+                if (!CropFace(image, points, face)) return nullptr;
+                return ExtractCroppedFaceParallel(face, features);
+            }
+
+            Ticket ExtractCroppedFaceParallel(const SharedImage &image, float *features) const
+            {
+                if (!features || !HasModel()) return nullptr;
+                SharedImage local_image = image;
+                return Submit(ExtractionScheduler::INTERACTIVE, [this, local_image, features](int id)
+                {
+                    m_cores[id]->ExtractCroppedFace(local_image.view, features);
+                });
             }
 
             bool Extract(const SeetaImageData &image, const SeetaPointF *points, float *features) const
@@ -101,125 +272,616 @@ namespace seeta
                 return true;
             }
 
-            orz::Cartridge *CompareParallel(const float *features1, const float *features2, float *similarity) const
+            /**
+             * \brief take a free slot, or append one, locked by caller
+             */
+            size_t AcquireSlot(int64_t index) const
+            {
+                size_t slot;
+                if (!m_free_slots.empty())
+                {
+                    slot = m_free_slots.back();
+                    m_free_slots.pop_back();
+                }
+                else
+                {
+                    slot = m_slot_index.size();
+                    m_slot_index.push_back(-1);
+                    m_features.resize(m_features.size() + m_dim);
+                    m_signatures.resize(m_signatures.size() + m_signature_words);
+                    m_tail_norms.resize(m_tail_norms.size() + m_tail_blocks);
+                    m_slot_identity.push_back(-1);
+                }
+                m_slot_index[slot] = index;
+                m_db.insert(std::make_pair(index, slot));
+                return slot;
+            }
+
+            const float *Row(size_t slot) const { return m_features.data() + slot * m_dim; }
+
+            const uint64_t *Signature(size_t slot) const { return m_signatures.data() + slot * m_signature_words; }
+
+            /**
+             * \brief norm of dims [b * ABANDON_BLOCK, dim) for each block b
+             */
+            void TailNorms(const float *features, float *tails) const
+            {
+                double sum = 0;
+                for (size_t b = m_tail_blocks; b-- > 0;)
+                {
+                    const auto first = b * ABANDON_BLOCK;
+                    const auto second = std::min(first + ABANDON_BLOCK, m_dim);
+                    for (size_t i = first; i < second; ++i) sum += double(features[i]) * features[i];
+                    tails[b] = float(std::sqrt(sum));
+                }
+            }
+
+            /**
+             * \brief update signature and tail norms after row of slot written, locked by caller
+             */
+            void UpdateSignature(size_t slot) const
+            {
+                kernel::sign_signature(Row(slot), int(m_dim), &m_signatures[slot * m_signature_words], int(m_signature_words));
+                TailNorms(Row(slot), &m_tail_norms[slot * m_tail_blocks]);
+            }
+
+            /**
+             * \brief features in storage space, rotated if rotation learned, locked by caller
+             * \param buffer used if rotated
+             */
+            const float *Project(const float *features, std::vector<float> &buffer) const
+            {
+                if (m_rotation.empty()) return features;
+                buffer.resize(m_dim);
+                rotate(m_rotation.data(), int(m_dim), features, buffer.data());
+                return buffer.data();
+            }
+
+            int64_t Insert(const float *features) const
+            {
+                const auto start = DatabaseMetrics::Clock::now();
+                int64_t new_index;
+                {
+                    unique_write_lock<MeteredRwMutex> _locker(m_db_mutex);
+                    new_index = m_max_index++;
+                    auto slot = AcquireSlot(new_index);
+                    if (m_rotation.empty())
+                    {
+                        std::memcpy(&m_features[slot * m_dim], features, m_dim * sizeof(float));
+                    }
+                    else
+                    {
+                        rotate(m_rotation.data(), int(m_dim), features, &m_features[slot * m_dim]);
+                    }
+                    UpdateSignature(slot);
+                }
+                Watch(features, new_index);
+                m_metrics.registrations.fetch_add(1, std::memory_order_relaxed);
+                const auto end = DatabaseMetrics::Clock::now();
+                m_metrics.insert_latency.record(end - start);
+                Tracer::Global().record("insertion", "insert", start, end);
+                return new_index;
+            }
+
+            /**
+             * \brief score new face against all standing queries at once, matches are reported on alert queue
+             */
+            void Watch(const float *features, int64_t index) const
             {
-                if (!features1 || !features2 || !similarity) return nullptr;
-                return m_comparation_gun->fire([this, features1, features2, similarity](int)
+                unique_read_lock<rwmutex> _locker(m_standing_mutex);
+                const auto queries = m_standing_ids.size();
+                if (queries == 0 || !m_standing_callback) return;
+                std::vector<float> scores(queries);
+                SimilarityMany(features, m_standing_probes.data(), m_dim, queries, scores.data());
+                std::vector<std::pair<int64_t, float>> matches;
+                for (size_t i = 0; i < queries; ++i)
+                {
+                    if (scores[i] >= m_standing_thresholds[i]) matches.emplace_back(m_standing_ids[i], scores[i]);
+                }
+                if (matches.empty()) return;
+                auto callback = m_standing_callback;
+                m_alert_queue([callback, matches, index]()
                 {
-                    *similarity = m_main_core->CalculateSimilarity(features1, features2);
+                    for (auto &match : matches) callback(match.first, index, match.second);
                 });
             }
 
-            void JoinComparation() const
+            int64_t AddStandingQuery(const float *probe, float threshold)
+            {
+                unique_write_lock<rwmutex> _locker(m_standing_mutex);
+                const auto id = m_standing_max_id++;
+                m_standing_probes.insert(m_standing_probes.end(), probe, probe + m_dim);
+                m_standing_ids.push_back(id);
+                m_standing_thresholds.push_back(threshold);
+                return id;
+            }
+
+            int RemoveStandingQuery(int64_t id)
+            {
+                unique_write_lock<rwmutex> _locker(m_standing_mutex);
+                auto it = std::find(m_standing_ids.begin(), m_standing_ids.end(), id);
+                if (it == m_standing_ids.end()) return 0;
+                // move last probe into the hole
+                const auto i = size_t(it - m_standing_ids.begin());
+                const auto last = m_standing_ids.size() - 1;
+                if (i != last)
+                {
+                    m_standing_ids[i] = m_standing_ids[last];
+                    m_standing_thresholds[i] = m_standing_thresholds[last];
+                    std::memcpy(&m_standing_probes[i * m_dim], &m_standing_probes[last * m_dim], m_dim * sizeof(float));
+                }
+                m_standing_ids.pop_back();
+                m_standing_thresholds.pop_back();
+                m_standing_probes.resize(last * m_dim);
+                return 1;
+            }
+
+            void SetStandingCallback(const FaceDatabase::StandingCallback &callback)
+            {
+                unique_write_lock<rwmutex> _locker(m_standing_mutex);
+                m_standing_callback = callback;
+            }
+
+            void JoinAlerts() const
             {
-                m_comparation_gun->join();
+                m_alert_queue.join();
             }
 
             int64_t Insert(const std::shared_ptr<float> &features) const
             {
-                unique_write_lock<rwmutex> _locker(m_db_mutex);
-                auto new_index = m_max_index++;
-                m_db.insert(std::make_pair(new_index, features));
-                return new_index;
+                return Insert(features.get());
+            }
+
+            /**
+             * \brief each priority has its own insertion queue, so joining interactive work never waits for bulk insertions
+             */
+            const Executor::Strand &InsertionQueue(ExtractionScheduler::Priority priority) const
+            {
+                return priority == ExtractionScheduler::BULK ? m_bulk_insertion_queue : m_insertion_queue;
             }
 
-            void InsertParallel(const std::shared_ptr<float> &features, int64_t *index) const
+            void InsertParallel(const std::shared_ptr<float> &features, int64_t *index, ExtractionScheduler::Priority priority) const
             {
                 auto local_features = features;
-                m_insertion_queue([this, local_features, index]()
+                const auto queued = Tracer::Clock::now();
+                InsertionQueue(priority)([this, local_features, index, queued]()
                 {
+                    Tracer::Global().record("insertion", "enqueue", queued, Tracer::Clock::now());
                     *index = Insert(local_features);
                 });
             }
 
             void JoinInsertion() const
             {
-                m_insertion_queue.join();
+                InsertionQueue(ExtractionScheduler::INTERACTIVE).join();
+                InsertionQueue(ExtractionScheduler::BULK).join();
             }
 
             int Delete(int64_t index)
             {
-                unique_write_lock<rwmutex> _locker(m_db_mutex);
-                return int(m_db.erase(index));
+                unique_write_lock<MeteredRwMutex> _locker(m_db_mutex);
+                auto it = m_db.find(index);
+                if (it == m_db.end()) return 0;
+                auto slot = it->second;
+                m_db.erase(it);
+                UnbindSlot(slot);
+                for (auto tag = m_tags.begin(); tag != m_tags.end();)
+                {
+                    tag->second.erase(slot);
+                    if (tag->second.empty()) tag = m_tags.erase(tag);
+                    else ++tag;
+                }
+                m_slot_index[slot] = -1;
+                m_free_slots.push_back(slot);
+                ++m_generation;
+                return 1;
             }
 
             size_t Count() const
             {
-                unique_read_lock<rwmutex> _locker(m_db_mutex);
+                unique_read_lock<MeteredRwMutex> _locker(m_db_mutex);
                 return m_db.size();
             }
 
             void Clear()
             {
-                unique_write_lock<rwmutex> _locker(m_db_mutex);
-                m_db.clear();
+                unique_write_lock<MeteredRwMutex> _locker(m_db_mutex);
+                ClearStorage();
                 m_max_index = 0;
             }
 
-            orz::Cartridge *RegisterParallel(const SeetaImageData &image, const SeetaPointF *points, int64_t *index) const
+            void ClearStorage() const
+            {
+                ++m_generation;
+                m_db.clear();
+                m_features.clear();
+                m_slot_index.clear();
+                m_free_slots.clear();
+                m_signatures.clear();
+                m_tail_norms.clear();
+                m_tags.clear();
+                m_slot_identity.clear();
+                m_identity_rows.clear();
+                m_row_identity.clear();
+                m_identity_slots.clear();
+                m_centroids.clear();
+            }
+
+            /**
+             * \brief centroid of identity row, normalized mean of its templates, locked by caller
+             */
+            void UpdateCentroid(size_t row) const
+            {
+                float *centroid = &m_centroids[row * m_dim];
+                std::fill(centroid, centroid + m_dim, 0.0f);
+                for (auto slot : m_identity_slots[row])
+                {
+                    const float *features = Row(slot);
+                    for (size_t i = 0; i < m_dim; ++i) centroid[i] += features[i];
+                }
+                kernel::normalize(centroid, int(m_dim));
+            }
+
+            /**
+             * \brief add slot to templates of identity, locked by caller
+             */
+            void BindSlot(size_t slot, int64_t identity) const
+            {
+                UnbindSlot(slot);
+                size_t row;
+                auto it = m_identity_rows.find(identity);
+                if (it == m_identity_rows.end())
+                {
+                    row = m_row_identity.size();
+                    m_identity_rows.insert(std::make_pair(identity, row));
+                    m_row_identity.push_back(identity);
+                    m_identity_slots.emplace_back();
+                    m_centroids.resize(m_centroids.size() + m_dim);
+                }
+                else
+                {
+                    row = it->second;
+                }
+                m_identity_slots[row].push_back(slot);
+                m_slot_identity[slot] = identity;
+                UpdateCentroid(row);
+            }
+
+            /**
+             * \brief remove slot from templates of its identity, identity without templates is dropped, locked by caller
+             */
+            void UnbindSlot(size_t slot) const
+            {
+                const auto identity = m_slot_identity[slot];
+                if (identity < 0) return;
+                m_slot_identity[slot] = -1;
+                const auto row = m_identity_rows[identity];
+                auto &slots = m_identity_slots[row];
+                slots.erase(std::find(slots.begin(), slots.end(), slot));
+                if (!slots.empty())
+                {
+                    UpdateCentroid(row);
+                    return;
+                }
+                // move last identity row into the hole
+                const auto last = m_row_identity.size() - 1;
+                m_identity_rows.erase(identity);
+                if (row != last)
+                {
+                    m_row_identity[row] = m_row_identity[last];
+                    m_identity_slots[row].swap(m_identity_slots[last]);
+                    std::memcpy(&m_centroids[row * m_dim], &m_centroids[last * m_dim], m_dim * sizeof(float));
+                    m_identity_rows[m_row_identity[row]] = row;
+                }
+                m_row_identity.pop_back();
+                m_identity_slots.pop_back();
+                m_centroids.resize(last * m_dim);
+            }
+
+            /**
+             * \brief bulk registrations queue behind interactive ones, and are dropped with index -1 once past deadline
+             */
+            Ticket RegisterParallel(const SeetaImageData &image, const SeetaPointF *points, int64_t *index,
+                ExtractionScheduler::Priority priority = ExtractionScheduler::INTERACTIVE,
+                ExtractionScheduler::Clock::time_point deadline = ExtractionScheduler::Clock::time_point::max()) const
             {
                 if (!points || !index) return nullptr;
-                seeta::ImageData local_image = image;
+                SharedImage face;
+                if (!CropFace(image, points, face))
+                {
+                    *index = -1;
+                    return nullptr;
+                }
+                return RegisterCroppedFaceParallel(face, index, priority, deadline);
+            }
+
+            /**
+             * \brief frame is shared with worker without copy, and cropped there
+             */
+            Ticket RegisterSharedParallel(const seeta::ImageData &image, const SeetaPointF *points, int64_t *index) const
+            {
+                if (!points || !index) return nullptr;
+                if (!HasModel())
+                {
+                    *index = -1;
+                    return nullptr;
+                }
+                SharedImage shared_image = image;
                 std::vector<SeetaPointF> local_points(points, points + 5);
-                return m_extraction_gun->fire([this, local_image, local_points, index](int id)
+                return Submit(ExtractionScheduler::INTERACTIVE, [this, shared_image, local_points, index](int id)
                 {
-                    std::shared_ptr<float> features(new float[m_cores[id]->GetExtractFeatureSize()], std::default_delete<float[]>());
-                    bool succeed = m_cores[id]->Extract(local_image, local_points.data(), features.get());
+                    auto features = BufferPool::Global().shared<float>(size_t(m_cores[id]->GetExtractFeatureSize()));
+                    bool succeed = m_cores[id]->Extract(shared_image.view, local_points.data(), features.get());
                     if (!succeed)
                     {
+                        m_metrics.registration_failures.fetch_add(1, std::memory_order_relaxed);
                         *index = -1;
                         return;
                     }
-                    InsertParallel(features, index);
+                    InsertParallel(features, index, ExtractionScheduler::INTERACTIVE);
                 });
             }
 
-            orz::Cartridge *RegisterCroppedFaceParallel(const SeetaImageData &image, int64_t *index) const
+            Ticket RegisterCroppedFaceParallel(const SharedImage &image, int64_t *index,
+                ExtractionScheduler::Priority priority = ExtractionScheduler::INTERACTIVE,
+                ExtractionScheduler::Clock::time_point deadline = ExtractionScheduler::Clock::time_point::max()) const
             {
                 if (!index) return nullptr;
-                seeta::ImageData local_image = image;
-                return m_extraction_gun->fire([this, local_image, index](int id)
+                if (!HasModel())
+                {
+                    *index = -1;
+                    return nullptr;
+                }
+                SharedImage local_image = image;
+                return Submit(priority, [this, local_image, index, priority](int id)
                 {
-                    std::shared_ptr<float> features(new float[m_cores[id]->GetExtractFeatureSize()], std::default_delete<float[]>());
-                    bool succeed = m_cores[id]->ExtractCroppedFace(local_image, features.get());
+                    auto features = BufferPool::Global().shared<float>(size_t(m_cores[id]->GetExtractFeatureSize()));
+                    bool succeed = m_cores[id]->ExtractCroppedFace(local_image.view, features.get());
                     if (!succeed)
                     {
+                        m_metrics.registration_failures.fetch_add(1, std::memory_order_relaxed);
                         *index = -1;
                         return;
                     }
-                    InsertParallel(features, index);
-                });
+                    InsertParallel(features, index, priority);
+                }, [this, index]()
+                {
+                    m_metrics.registration_failures.fetch_add(1, std::memory_order_relaxed);
+                    *index = -1;
+                }, deadline);
+            }
+
+            /**
+             * \brief deadline_ms from now, negative for none
+             */
+            static ExtractionScheduler::Clock::time_point Deadline(int64_t deadline_ms)
+            {
+                if (deadline_ms < 0) return ExtractionScheduler::Clock::time_point::max();
+                return ExtractionScheduler::Clock::now() + std::chrono::milliseconds(deadline_ms);
             }
 
             void JoinRegisteration() const
             {
-                m_extraction_gun->join();
+                SEETA_TRACE_SCOPE("registration", "join");
+                m_extraction_scheduler->join();
                 JoinInsertion();
             }
 
-            size_t QueryTop(const float *features, size_t N, int64_t* index, float* similarity) const
+            /**
+             * \brief wait registrations of priority, extracted and inserted
+             */
+            void JoinRegisteration(ExtractionScheduler::Priority priority) const
+            {
+                SEETA_TRACE_SCOPE("registration", "join");
+                m_extraction_scheduler->join(priority);
+                InsertionQueue(priority).join();
+            }
+
+            /**
+             * \brief run block(first, second) over [0, count), one block per comparation core
+             */
+            template <typename FUNC>
+            void ParallelFor(size_t count, FUNC block) const
+            {
+                m_executor.parallel_for(count, comparation_core_number(), block);
+            }
+
+            template <typename FUNC>
+            void ParallelSlots(FUNC block) const
+            {
+                ParallelFor(m_slot_index.size(), block);
+            }
+
+            /**
+             * \brief compare features with every slot, one block per comparation core, locked by caller
+             * \param features query features
+             * \param scores similarity of each slot, free slots are filled too but meaningless
+             */
+            void Scan(const float *features, float *scores) const
+            {
+                SEETA_TRACE_SCOPE("query", "scan");
+                ParallelSlots([this, features, scores](size_t first, size_t second)
+                {
+                    SimilarityMany(features, Row(first), m_dim, second - first, scores + first);
+                });
+            }
+
+            /**
+             * \brief coarse scan by hamming distance of signatures, then re-rank candidates exactly, locked by caller
+             * \return (index, similarity) of candidates
+             */
+            std::vector<std::pair<int64_t, float>> PrefilterScan(const float *features, size_t candidates) const
+            {
+                SEETA_TRACE_SCOPE("query", "scan");
+                std::vector<uint64_t> query(m_signature_words);
+                kernel::sign_signature(features, int(m_dim), query.data(), int(m_signature_words));
+
+                std::vector<int> distance(m_slot_index.size());
+                ParallelSlots([&](size_t first, size_t second)
+                {
+                    const auto words = int(m_signature_words);
+                    for (size_t slot = first; slot < second; ++slot)
+                    {
+                        distance[slot] = kernel::hamming(query.data(), Signature(slot), words);
+                    }
+                });
+
+                std::vector<std::pair<int, size_t>> order;
+                order.reserve(m_db.size());
+                for (size_t slot = 0; slot < m_slot_index.size(); ++slot)
+                {
+                    if (m_slot_index[slot] < 0) continue;
+                    order.emplace_back(distance[slot], slot);
+                }
+                candidates = std::min(candidates, order.size());
+                std::nth_element(order.begin(), order.begin() + candidates, order.end());
+
+                // candidates are gathered into contiguous rows of each block, so re-rank is block compare on all comparation cores
+                std::vector<std::pair<int64_t, float>> result(candidates);
+                ParallelFor(candidates, [&](size_t first, size_t second)
+                {
+                    std::vector<float> rows((second - first) * m_dim);
+                    std::vector<float> scores(second - first);
+                    for (size_t i = first; i < second; ++i)
+                    {
+                        std::memcpy(&rows[(i - first) * m_dim], Row(order[i].second), m_dim * sizeof(float));
+                    }
+                    SimilarityMany(features, rows.data(), m_dim, second - first, scores.data());
+                    for (size_t i = first; i < second; ++i)
+                    {
+                        result[i].first = m_slot_index[order[i].second];
+                        result[i].second = scores[i - first];
+                    }
+                });
+                return result;
+            }
+
+            /**
+             * \brief scan rows block by block, stop a row once it can not reach threshold, locked by caller
+             * \param features query in storage space
+             * \param threshold inner product threshold
+             * \param scores inner product of each slot, -FLT_MAX for abandoned and free slots
+             */
+            void AbandonScan(const float *features, float threshold, float *scores) const
+            {
+                SEETA_TRACE_SCOPE("query", "scan");
+                std::vector<float> query_tails(m_tail_blocks + 1, 0);
+                TailNorms(features, query_tails.data());
+                // loose bound a little for rounding error
+                const float bar = threshold - 1e-4f;
+                ParallelSlots([&](size_t first, size_t second)
+                {
+                    const auto full_blocks = m_dim / ABANDON_BLOCK;
+                    for (size_t slot = first; slot < second; ++slot)
+                    {
+                        scores[slot] = -FLT_MAX;
+                        if (m_slot_index[slot] < 0) continue;
+                        const float *row = Row(slot);
+                        const float *row_tails = &m_tail_norms[slot * m_tail_blocks];
+                        float partial = 0;
+                        size_t b = 0;
+                        for (; b < full_blocks; ++b)
+                        {
+                            partial += kernel::dot<ABANDON_BLOCK>(features + b * ABANDON_BLOCK, row + b * ABANDON_BLOCK);
+                            if (b + 1 < m_tail_blocks && partial + query_tails[b + 1] * row_tails[b + 1] < bar) break;
+                        }
+                        if (b < full_blocks) continue;
+                        if (full_blocks < m_tail_blocks)
+                        {
+                            const auto tail = full_blocks * ABANDON_BLOCK;
+                            partial += kernel::dot(features + tail, row + tail, int(m_dim - tail));
+                        }
+                        scores[slot] = partial;
+                    }
+                });
+            }
+
+            /**
+             * \brief slots having all tags, in ascending order, locked by caller
+             */
+            std::vector<size_t> SelectSlots(const int32_t *tags, size_t tag_count) const
+            {
+                std::vector<size_t> slots;
+                std::vector<const SlotSet *> sets;
+                for (size_t i = 0; i < tag_count; ++i)
+                {
+                    auto it = m_tags.find(tags[i]);
+                    if (it == m_tags.end()) return slots;
+                    sets.push_back(&it->second);
+                }
+                SlotSet::intersect(sets, slots);
+                return slots;
+            }
+
+            /**
+             * \brief compare features with selected slots only, consecutive slots are compared in one call, locked by caller
+             * \return (index, similarity) of each slot
+             */
+            std::vector<std::pair<int64_t, float>> ScoreSlots(const float *features, const std::vector<size_t> &slots) const
+            {
+                SEETA_TRACE_SCOPE("query", "scan");
+                std::vector<std::pair<int64_t, float>> result(slots.size());
+                ParallelFor(slots.size(), [&](size_t first, size_t second)
+                {
+                    std::vector<float> scores;
+                    while (first < second)
+                    {
+                        auto run = first + 1;
+                        while (run < second && slots[run] == slots[run - 1] + 1) ++run;
+                        scores.resize(run - first);
+                        SimilarityMany(features, Row(slots[first]), m_dim, run - first, scores.data());
+                        for (auto i = first; i < run; ++i)
+                        {
+                            result[i].first = m_slot_index[slots[i]];
+                            result[i].second = scores[i - first];
+                        }
+                        first = run;
+                    }
+                });
+                return result;
+            }
+
+            size_t QueryTop(const float *query, size_t N, int64_t* index, float* similarity,
+                            const int32_t *tags = nullptr, size_t tag_count = 0) const
             {
-                unique_read_lock<rwmutex> _read_locker(m_db_mutex);
+                DatabaseMetrics::QueryTimer timer(m_metrics, DatabaseMetrics::QUERY_TOP);
+                unique_read_lock<MeteredRwMutex> _read_locker(m_db_mutex);
+
+                std::vector<float> projected;
+                const float *features = Project(query, projected);
 
-                std::vector<std::pair<int64_t, float>> result(m_db.size());
+                std::vector<std::pair<int64_t, float>> result;
+                if (tags != nullptr && tag_count > 0)
+                {
+                    result = ScoreSlots(features, SelectSlots(tags, tag_count));
+                    timer.set(DatabaseMetrics::QUERY_TOP_PARTITION, result.size());
+                }
+                else if (m_prefilter_candidates > 0 && m_prefilter_candidates < m_db.size())
+                {
+                    result = PrefilterScan(features, std::max(m_prefilter_candidates, N));
+                    timer.set(DatabaseMetrics::QUERY_TOP_PREFILTER, result.size());
+                }
+                else
                 {
-                    std::unique_lock<std::mutex> _locker(m_comparation_mutex);
-                    size_t i = 0;
-                    for (auto &line : m_db)
+                    timer.set(DatabaseMetrics::QUERY_TOP, m_db.size());
+                    PooledArray<float> scores(m_slot_index.size());
+                    Scan(features, scores.data());
+
+                    result.reserve(m_db.size());
+                    for (size_t slot = 0; slot < m_slot_index.size(); ++slot)
                     {
-                        result[i].first = line.first;
-                        CompareParallel(features, line.second.get(), &result[i].second);
-                        i++;
+                        if (m_slot_index[slot] < 0) continue;
+                        result.emplace_back(m_slot_index[slot], scores[slot]);
                     }
-                    JoinComparation();
                 }
 
-                std::partial_sort(result.begin(), result.begin() + N, result.end(), [](
+                SEETA_TRACE_SCOPE("query", "sort");
+                const size_t top_n = std::min(N, result.size());
+                std::partial_sort(result.begin(), result.begin() + top_n, result.end(), [](
                     const std::pair<int64_t, float> &a, const std::pair<int64_t, float> &b) -> bool
                 {
                     return a.second > b.second;
                 });
-                const size_t top_n = std::min(N, result.size());
                 for (size_t i = 0; i < top_n; ++i)
                 {
                     index[i] = result[i].first;
@@ -228,33 +890,539 @@ namespace seeta
                 return top_n;
             }
 
-            class IndexWithSimilarity
+            /**
+             * \brief fuse scores into one, scores may be reordered
+             */
+            float Aggregate(std::vector<float> &scores, FaceDatabase::Aggregation aggregation) const
             {
-            public:
-                IndexWithSimilarity() = default;
-                IndexWithSimilarity(int64_t index, float similarity)
-                    : index(index), similarity(similarity) {}
-
-                int64_t index = -1;
-                float similarity = 0;
-            };
+                switch (aggregation)
+                {
+                default:
+                case FaceDatabase::AGGREGATION_MAX:
+                    return *std::max_element(scores.begin(), scores.end());
+                case FaceDatabase::AGGREGATION_MEAN_TOP_K:
+                {
+                    const auto k = std::max<size_t>(1, std::min(m_aggregation_top_k, scores.size()));
+                    std::partial_sort(scores.begin(), scores.begin() + k, scores.end(), std::greater<float>());
+                    double sum = 0;
+                    for (size_t i = 0; i < k; ++i) sum += scores[i];
+                    return float(sum / k);
+                }
+                case FaceDatabase::AGGREGATION_MEAN:
+                {
+                    double sum = 0;
+                    for (auto score : scores) sum += score;
+                    return float(sum / scores.size());
+                }
+                case FaceDatabase::AGGREGATION_SOFTMAX:
+                {
+                    // weights exp(s / t), shifted by max score for stability
+                    const auto top = *std::max_element(scores.begin(), scores.end());
+                    double weighted = 0, weights = 0;
+                    for (auto score : scores)
+                    {
+                        const double weight = std::exp((score - top) / m_softmax_temperature);
+                        weighted += weight * score;
+                        weights += weight;
+                    }
+                    return float(weighted / weights);
+                }
+                }
+            }
 
-            static size_t SortAbove(IndexWithSimilarity *data, size_t N, float threshold)
+            /**
+             * \brief score every probe against rows of one tile while the tile is in cache, then fuse, locked by caller
+             * \param probes k probes in storage space, m_dim floats each
+             */
+            size_t QueryTopMultiProbe(const float *probes, size_t k, FaceDatabase::Aggregation aggregation, size_t N, int64_t *index, float *similarity) const
             {
-                if (N == 0) return 0;
-                std::stack<std::pair<int64_t, int64_t>> sort_stack;
-                sort_stack.push(std::make_pair(0, N - 1));
-                int64_t left_bound = -1;
-                int64_t right_bound = int64_t(N);
-                while (!sort_stack.empty())
+                DatabaseMetrics::QueryTimer timer(m_metrics, DatabaseMetrics::QUERY_MULTI_PROBE);
+                unique_read_lock<MeteredRwMutex> _read_locker(m_db_mutex);
+                timer.set(DatabaseMetrics::QUERY_MULTI_PROBE, m_db.size() * k);
+
+                std::vector<float> projected;
+                if (!m_rotation.empty())
                 {
-                    const auto const_left = sort_stack.top().first;
-                    const auto const_right = sort_stack.top().second;
-                    sort_stack.pop();
-                    // end case
-                    if (const_right < const_left)
+                    projected.resize(k * m_dim);
+                    for (size_t p = 0; p < k; ++p) rotate(m_rotation.data(), int(m_dim), probes + p * m_dim, &projected[p * m_dim]);
+                    probes = projected.data();
+                }
+
+                PooledArray<float> fused(m_slot_index.size());
+                {
+                    SEETA_TRACE_SCOPE("query", "scan");
+                    ParallelSlots([&](size_t first, size_t second)
                     {
-                        continue;
+                        std::vector<float> tile(k * PROBE_TILE);
+                        std::vector<float> scores(k);
+                        for (auto begin = first; begin < second; begin += PROBE_TILE)
+                        {
+                            const auto rows = std::min(size_t(PROBE_TILE), second - begin);
+                            for (size_t p = 0; p < k; ++p)
+                            {
+                                SimilarityMany(probes + p * m_dim, Row(begin), m_dim, rows, &tile[p * PROBE_TILE]);
+                            }
+                            for (size_t r = 0; r < rows; ++r)
+                            {
+                                for (size_t p = 0; p < k; ++p) scores[p] = tile[p * PROBE_TILE + r];
+                                fused[begin + r] = Aggregate(scores, aggregation);
+                            }
+                        }
+                    });
+                }
+
+                std::vector<std::pair<int64_t, float>> result;
+                result.reserve(m_db.size());
+                for (size_t slot = 0; slot < m_slot_index.size(); ++slot)
+                {
+                    if (m_slot_index[slot] < 0) continue;
+                    result.emplace_back(m_slot_index[slot], fused[slot]);
+                }
+
+                SEETA_TRACE_SCOPE("query", "sort");
+                const size_t top_n = std::min(N, result.size());
+                std::partial_sort(result.begin(), result.begin() + top_n, result.end(), [](
+                    const std::pair<int64_t, float> &a, const std::pair<int64_t, float> &b) -> bool
+                {
+                    return a.second > b.second;
+                });
+                for (size_t i = 0; i < top_n; ++i)
+                {
+                    index[i] = result[i].first;
+                    similarity[i] = result[i].second;
+                }
+                return top_n;
+            }
+
+            size_t QueryTopIdentities(const float *query, FaceDatabase::Aggregation aggregation, size_t N, int64_t *identity, float *similarity) const
+            {
+                DatabaseMetrics::QueryTimer timer(m_metrics, DatabaseMetrics::QUERY_IDENTITIES);
+                unique_read_lock<MeteredRwMutex> _read_locker(m_db_mutex);
+
+                std::vector<float> projected;
+                const float *features = Project(query, projected);
+
+                const auto identities = m_row_identity.size();
+                std::vector<std::pair<int64_t, float>> result;
+                if (m_centroid_candidates > 0 && std::max(m_centroid_candidates, N) < identities)
+                {
+                    // rank centroids, then expand templates of leading identities only
+                    SEETA_TRACE_SCOPE("query", "scan");
+                    std::vector<float> centroid_scores(identities);
+                    ParallelFor(identities, [&](size_t first, size_t second)
+                    {
+                        SimilarityMany(features, &m_centroids[first * m_dim], m_dim, second - first, centroid_scores.data() + first);
+                    });
+                    std::vector<std::pair<float, size_t>> order(identities);
+                    for (size_t row = 0; row < identities; ++row) order[row] = std::make_pair(centroid_scores[row], row);
+                    const auto candidates = std::max(m_centroid_candidates, N);
+                    std::nth_element(order.begin(), order.begin() + candidates, order.end(), std::greater<std::pair<float, size_t>>());
+
+                    size_t expanded = 0;
+                    for (size_t i = 0; i < candidates; ++i) expanded += m_identity_slots[order[i].second].size();
+                    timer.set(DatabaseMetrics::QUERY_IDENTITIES_CENTROID, identities + expanded);
+
+                    result.resize(candidates);
+                    ParallelFor(candidates, [&](size_t first, size_t second)
+                    {
+                        std::vector<float> scores;
+                        for (size_t i = first; i < second; ++i)
+                        {
+                            const auto row = order[i].second;
+                            auto &slots = m_identity_slots[row];
+                            scores.resize(slots.size());
+                            for (size_t j = 0; j < slots.size(); ++j) scores[j] = Similarity(features, Row(slots[j]));
+                            result[i] = std::make_pair(m_row_identity[row], Aggregate(scores, aggregation));
+                        }
+                    });
+                }
+                else
+                {
+                    timer.set(DatabaseMetrics::QUERY_IDENTITIES, m_db.size());
+                    PooledArray<float> slot_scores(m_slot_index.size());
+                    Scan(features, slot_scores.data());
+                    result.resize(identities);
+                    ParallelFor(identities, [&](size_t first, size_t second)
+                    {
+                        std::vector<float> scores;
+                        for (size_t row = first; row < second; ++row)
+                        {
+                            auto &slots = m_identity_slots[row];
+                            scores.resize(slots.size());
+                            for (size_t j = 0; j < slots.size(); ++j) scores[j] = slot_scores[slots[j]];
+                            result[row] = std::make_pair(m_row_identity[row], Aggregate(scores, aggregation));
+                        }
+                    });
+                }
+
+                SEETA_TRACE_SCOPE("query", "sort");
+                const size_t top_n = std::min(N, result.size());
+                std::partial_sort(result.begin(), result.begin() + top_n, result.end(), [](
+                    const std::pair<int64_t, float> &a, const std::pair<int64_t, float> &b) -> bool
+                {
+                    return a.second > b.second;
+                });
+                for (size_t i = 0; i < top_n; ++i)
+                {
+                    identity[i] = result[i].first;
+                    similarity[i] = result[i].second;
+                }
+                return top_n;
+            }
+
+            struct SlotPair
+            {
+                size_t first;
+                size_t second;
+                float similarity;
+            };
+
+            /**
+             * \brief faces of gallery version (slots, max_index), faces registered later are left out, locked by caller
+             * \param faces [out] index of each slot below slots, -1 for free or later slot
+             * \return number of faces in version
+             */
+            size_t VersionFaces(size_t slots, int64_t max_index, std::vector<int64_t> &faces) const
+            {
+                faces.assign(slots, -1);
+                size_t count = 0;
+                for (size_t slot = 0; slot < slots && slot < m_slot_index.size(); ++slot)
+                {
+                    if (m_slot_index[slot] < 0 || m_slot_index[slot] >= max_index) continue;
+                    faces[slot] = m_slot_index[slot];
+                    ++count;
+                }
+                return count;
+            }
+
+            /**
+             * \brief all-pairs job over faces, rows are taken PAIR_BLOCK slots a time and compared tile by tile with later columns
+             * \param faces index of each slot taken by job, -1 for skipped slot, from VersionFaces
+             * \param generation m_generation when faces were taken
+             * \param top_k 0 for every pair above threshold once, or best top_k neighbours of each row
+             * \param finished row blocks to skip, resized to block count
+             * \param emit called with pairs of one row block, calls are serialized and not locked
+             * \param finish called after all pairs of row block emitted, calls are serialized and not locked
+             * \return false if stored rows were removed or rewritten meanwhile, job is stopped then
+             * \note read lock is held for one tile a time, registrations go on and are not part of job
+             */
+            template <typename EMIT, typename FINISH>
+            bool ScanPairs(const std::vector<int64_t> &faces, uint64_t generation, float threshold, size_t top_k,
+                           std::vector<bool> &finished, EMIT emit, FINISH finish) const
+            {
+                const auto slots = faces.size();
+                const auto blocks = (slots + PAIR_BLOCK - 1) / PAIR_BLOCK;
+                finished.resize(blocks, false);
+                const auto workers = std::max<size_t>(1, comparation_core_number());
+                std::mutex emit_mutex;
+                std::atomic<bool> stale(false);
+                ParallelFor(workers, [&](size_t first_worker, size_t second_worker)
+                {
+                    std::vector<float> tile(PAIR_BLOCK);
+                    std::vector<SlotPair> pairs;
+                    std::vector<std::vector<std::pair<float, size_t>>> heaps;
+                    auto greater = [](const std::pair<float, size_t> &a, const std::pair<float, size_t> &b) { return a.first > b.first; };
+                    // blocks are interleaved over workers, rows of triangle shrink as block goes
+                    for (auto worker = first_worker; worker < second_worker; ++worker)
+                    for (auto block = worker; block < blocks; block += workers)
+                    {
+                        if (finished[block]) continue;
+                        if (stale) return;
+                        const auto row_begin = block * PAIR_BLOCK;
+                        const auto row_end = std::min(slots, row_begin + PAIR_BLOCK);
+                        pairs.clear();
+                        if (top_k > 0) heaps.assign(row_end - row_begin, std::vector<std::pair<float, size_t>>());
+                        for (auto col_begin = top_k > 0 ? 0 : row_begin; col_begin < slots; col_begin += PAIR_BLOCK)
+                        {
+                            const auto col_end = std::min(slots, col_begin + PAIR_BLOCK);
+                            {
+                                // locked per tile, so a waiting writer holds back later readers for one tile at most
+                                unique_read_lock<MeteredRwMutex> _read_locker(m_db_mutex);
+                                if (m_generation != generation)
+                                {
+                                    stale = true;
+                                    return;
+                                }
+                                for (auto row = row_begin; row < row_end; ++row)
+                                {
+                                    if (faces[row] < 0) continue;
+                                    const auto col_first = top_k > 0 ? col_begin : std::max(col_begin, row + 1);
+                                    if (col_first >= col_end) continue;
+                                    SimilarityMany(Row(row), Row(col_first), m_dim, col_end - col_first, tile.data());
+                                    for (auto col = col_first; col < col_end; ++col)
+                                    {
+                                        const auto score = tile[col - col_first];
+                                        if (col == row || faces[col] < 0 || score < threshold) continue;
+                                        if (top_k == 0)
+                                        {
+                                            pairs.push_back(SlotPair{row, col, score});
+                                            continue;
+                                        }
+                                        auto &heap = heaps[row - row_begin];
+                                        if (heap.size() < top_k)
+                                        {
+                                            heap.emplace_back(score, col);
+                                            std::push_heap(heap.begin(), heap.end(), greater);
+                                        }
+                                        else if (score > heap.front().first)
+                                        {
+                                            std::pop_heap(heap.begin(), heap.end(), greater);
+                                            heap.back() = std::make_pair(score, col);
+                                            std::push_heap(heap.begin(), heap.end(), greater);
+                                        }
+                                    }
+                                }
+                            }
+                            // bound memory of dense blocks
+                            if (pairs.size() >= PAIR_FLUSH)
+                            {
+                                std::unique_lock<std::mutex> _locker(emit_mutex);
+                                emit(pairs);
+                                pairs.clear();
+                            }
+                        }
+                        for (size_t i = 0; i < heaps.size(); ++i)
+                        {
+                            std::sort_heap(heaps[i].begin(), heaps[i].end(), greater);
+                            for (auto &neighbour : heaps[i]) pairs.push_back(SlotPair{row_begin + i, neighbour.second, neighbour.first});
+                        }
+                        std::unique_lock<std::mutex> _locker(emit_mutex);
+                        if (!pairs.empty()) emit(pairs);
+                        finish(block);
+                    }
+                });
+                return !stale;
+            }
+
+#define MAGIC_CHECKPOINT 0x7737
+
+            bool ComparePairs(float threshold, size_t top_k, const FaceDatabase::PairCallback &callback, const char *checkpoint) const
+            {
+                // header pins the job and gallery version it runs on, faces below max_index in first slots slots
+                struct
+                {
+                    int32_t magic;
+                    float threshold;
+                    uint64_t top_k;
+                    uint64_t slots;
+                    uint64_t count;
+                    int64_t max_index;
+                    uint64_t block;
+                    uint64_t layout;    ///< hash of slot to index map, blocks are slot ranges so reordered slots can not resume
+                } header = { MAGIC_CHECKPOINT, threshold, top_k, 0, 0, 0, PAIR_BLOCK, 0 };
+
+                std::ifstream input;
+                if (checkpoint != nullptr) input.open(checkpoint, std::ios::binary);
+                auto loaded = header;
+                const bool resumed = input.is_open();
+                if (resumed)
+                {
+                    input.read(reinterpret_cast<char *>(&loaded), sizeof(loaded));
+                    if (!input || loaded.magic != header.magic || loaded.threshold != header.threshold
+                        || loaded.top_k != header.top_k || loaded.block != header.block)
+                    {
+                        orz::Log(orz::ERROR) << LOG_HEAD << "Checkpoint " << checkpoint << " does not match this job";
+                        return false;
+                    }
+                }
+
+                std::vector<int64_t> faces;
+                uint64_t generation;
+                {
+                    unique_read_lock<MeteredRwMutex> _read_locker(m_db_mutex);
+                    generation = m_generation;
+                    header.slots = resumed ? loaded.slots : m_slot_index.size();
+                    header.max_index = resumed ? loaded.max_index : m_max_index;
+                    header.count = VersionFaces(size_t(header.slots), header.max_index, faces);
+                    header.layout = hash64(faces.data(), faces.size() * sizeof(int64_t), header.slots);
+                    // faces of version removed since, or gallery reloaded and compacted into other slots
+                    if (resumed && (header.slots > m_slot_index.size() || header.max_index > m_max_index
+                                    || header.count != loaded.count || header.layout != loaded.layout))
+                    {
+                        orz::Log(orz::ERROR) << LOG_HEAD << "Checkpoint " << checkpoint << " does not match this gallery";
+                        return false;
+                    }
+                }
+
+                std::vector<bool> finished;
+                std::ofstream record;
+                if (checkpoint != nullptr)
+                {
+                    if (resumed)
+                    {
+                        finished.resize((faces.size() + PAIR_BLOCK - 1) / PAIR_BLOCK, false);
+                        uint64_t block;
+                        while (input.read(reinterpret_cast<char *>(&block), sizeof(block)))
+                        {
+                            if (block < finished.size()) finished[size_t(block)] = true;
+                        }
+                        input.close();
+                        record.open(checkpoint, std::ios::binary | std::ios::app);
+                    }
+                    else
+                    {
+                        record.open(checkpoint, std::ios::binary | std::ios::trunc);
+                        record.write(reinterpret_cast<const char *>(&header), sizeof(header));
+                    }
+                    if (!record.is_open())
+                    {
+                        orz::Log(orz::ERROR) << LOG_HEAD << "Can not open checkpoint " << checkpoint;
+                        return false;
+                    }
+                    record.flush();
+                }
+
+                const bool done = ScanPairs(faces, generation, threshold, top_k, finished, [&](const std::vector<SlotPair> &pairs)
+                {
+                    for (auto &pair : pairs) callback(faces[pair.first], faces[pair.second], pair.similarity);
+                }, [&](size_t block)
+                {
+                    if (!record.is_open()) return;
+                    const uint64_t id = block;
+                    record.write(reinterpret_cast<const char *>(&id), sizeof(id));
+                    record.flush();
+                });
+                if (!done)
+                {
+                    orz::Log(orz::ERROR) << LOG_HEAD << "ComparePairs stopped, faces were deleted or rewritten while running";
+                }
+                return done;
+            }
+
+            static size_t FindRoot(std::vector<size_t> &parent, size_t x)
+            {
+                while (parent[x] != x)
+                {
+                    parent[x] = parent[parent[x]];
+                    x = parent[x];
+                }
+                return x;
+            }
+
+            size_t Cluster(float threshold, size_t k, FaceDatabase::ClusterMethod method, int64_t *index, int64_t *cluster) const
+            {
+                std::vector<int64_t> faces;
+                uint64_t generation;
+                {
+                    unique_read_lock<MeteredRwMutex> _read_locker(m_db_mutex);
+                    generation = m_generation;
+                    VersionFaces(m_slot_index.size(), m_max_index, faces);
+                }
+
+                const auto slots = faces.size();
+                std::vector<size_t> label(slots);
+                for (size_t slot = 0; slot < slots; ++slot) label[slot] = slot;
+
+                // kNN graph over edges above threshold, by blocked brute force
+                std::vector<bool> finished;
+                bool done;
+                if (method == FaceDatabase::CLUSTER_CHINESE_WHISPERS)
+                {
+                    std::vector<std::vector<std::pair<size_t, float>>> graph(slots);
+                    done = ScanPairs(faces, generation, threshold, k, finished, [&](const std::vector<SlotPair> &pairs)
+                    {
+                        for (auto &pair : pairs)
+                        {
+                            graph[pair.first].emplace_back(pair.second, pair.similarity);
+                            graph[pair.second].emplace_back(pair.first, pair.similarity);
+                        }
+                    }, [](size_t) {});
+
+                    // every face takes the label with the largest weight among neighbours, until stable
+                    std::vector<size_t> order;
+                    for (size_t slot = 0; slot < slots; ++slot) if (faces[slot] >= 0 && !graph[slot].empty()) order.push_back(slot);
+                    std::mt19937 random(5489u);
+                    std::map<size_t, float> votes;
+                    for (int iteration = 0; iteration < WHISPERS_ITERATIONS; ++iteration)
+                    {
+                        std::shuffle(order.begin(), order.end(), random);
+                        bool changed = false;
+                        for (auto slot : order)
+                        {
+                            votes.clear();
+                            for (auto &edge : graph[slot]) votes[label[edge.first]] += edge.second;
+                            auto best = label[slot];
+                            float best_vote = -FLT_MAX;
+                            for (auto &vote : votes)
+                            {
+                                if (vote.second > best_vote)
+                                {
+                                    best = vote.first;
+                                    best_vote = vote.second;
+                                }
+                            }
+                            if (best != label[slot])
+                            {
+                                label[slot] = best;
+                                changed = true;
+                            }
+                        }
+                        if (!changed) break;
+                    }
+                }
+                else
+                {
+                    // union-find while edges stream in, no graph is kept
+                    done = ScanPairs(faces, generation, threshold, k, finished, [&](const std::vector<SlotPair> &pairs)
+                    {
+                        for (auto &pair : pairs)
+                        {
+                            auto a = FindRoot(label, pair.first);
+                            auto b = FindRoot(label, pair.second);
+                            if (a != b) label[std::max(a, b)] = std::min(a, b);
+                        }
+                    }, [](size_t) {});
+                    for (size_t slot = 0; slot < slots; ++slot) label[slot] = FindRoot(label, slot);
+                }
+
+                if (!done)
+                {
+                    orz::Log(orz::ERROR) << LOG_HEAD << "Cluster stopped, faces were deleted or rewritten while running";
+                    return 0;
+                }
+
+                // dense cluster ids, in order of first index
+                std::map<int64_t, size_t> ordered;
+                for (size_t slot = 0; slot < slots; ++slot) if (faces[slot] >= 0) ordered.insert(std::make_pair(faces[slot], slot));
+                std::map<size_t, int64_t> dense;
+                size_t count = 0;
+                for (auto &line : ordered)
+                {
+                    auto it = dense.insert(std::make_pair(label[line.second], int64_t(dense.size()))).first;
+                    index[count] = line.first;
+                    cluster[count] = it->second;
+                    ++count;
+                }
+                return count;
+            }
+
+            class IndexWithSimilarity
+            {
+            public:
+                IndexWithSimilarity() = default;
+                IndexWithSimilarity(int64_t index, float similarity)
+                    : index(index), similarity(similarity) {}
+
+                int64_t index = -1;
+                float similarity = 0;
+            };
+
+            static size_t SortAbove(IndexWithSimilarity *data, size_t N, float threshold)
+            {
+                if (N == 0) return 0;
+                std::stack<std::pair<int64_t, int64_t>> sort_stack;
+                sort_stack.push(std::make_pair(0, N - 1));
+                int64_t left_bound = -1;
+                int64_t right_bound = int64_t(N);
+                while (!sort_stack.empty())
+                {
+                    const auto const_left = sort_stack.top().first;
+                    const auto const_right = sort_stack.top().second;
+                    sort_stack.pop();
+                    // end case
+                    if (const_right < const_left)
+                    {
+                        continue;
                     }
                     else if (const_right == const_left)
                     {
@@ -295,141 +1463,775 @@ namespace seeta
                     }
                 }
 
-                int64_t sorted_size = left_bound + 1;
-                for (; sorted_size < right_bound; ++sorted_size)
+                int64_t sorted_size = left_bound + 1;
+                for (; sorted_size < right_bound; ++sorted_size)
+                {
+                    if (data[sorted_size].similarity < threshold) break;
+                }
+
+                return size_t(sorted_size);
+            }
+
+            size_t QueryAbove(const float *query, float threshold, size_t N, int64_t* index, float* similarity,
+                              const int32_t *tags = nullptr, size_t tag_count = 0) const
+            {
+                DatabaseMetrics::QueryTimer timer(m_metrics, DatabaseMetrics::QUERY_ABOVE);
+                unique_read_lock<MeteredRwMutex> _read_locker(m_db_mutex);
+
+                std::vector<float> projected;
+                const float *features = Project(query, projected);
+
+                PooledArray<float> scores(m_slot_index.size());
+                std::vector<IndexWithSimilarity> result;
+                const float bound = m_rotation.empty() ? -FLT_MAX : InnerProductThreshold(threshold);
+                if (tags != nullptr && tag_count > 0)
+                {
+                    for (auto &line : ScoreSlots(features, SelectSlots(tags, tag_count)))
+                    {
+                        result.emplace_back(line.first, line.second);
+                    }
+                    timer.set(DatabaseMetrics::QUERY_ABOVE_PARTITION, result.size());
+                }
+                else if (bound > -FLT_MAX)
+                {
+                    // abandoned rows are counted whole, their prefix was read
+                    timer.set(DatabaseMetrics::QUERY_ABOVE_ABANDON, m_db.size());
+                    AbandonScan(features, bound, scores.data());
+                    // survivors carry their full inner product, so only the similarity op is left to apply
+                    std::vector<float> survivors;
+                    for (size_t slot = 0; slot < m_slot_index.size(); ++slot)
+                    {
+                        if (scores[slot] == -FLT_MAX) continue;
+                        result.emplace_back(m_slot_index[slot], 0.0f);
+                        survivors.push_back(scores[slot]);
+                    }
+                    SimilarityFromInnerProduct(survivors.data(), survivors.size());
+                    for (size_t i = 0; i < survivors.size(); ++i) result[i].similarity = survivors[i];
+                }
+                else
+                {
+                    timer.set(DatabaseMetrics::QUERY_ABOVE, m_db.size());
+                    Scan(features, scores.data());
+                    result.reserve(m_db.size());
+                    for (size_t slot = 0; slot < m_slot_index.size(); ++slot)
+                    {
+                        if (m_slot_index[slot] < 0) continue;
+                        result.emplace_back(m_slot_index[slot], scores[slot]);
+                    }
+                }
+                // sort all above threshold
+                SEETA_TRACE_SCOPE("query", "sort");
+                size_t sorted = SortAbove(result.data(), result.size(), threshold);
+                const size_t top_n = std::min(N, sorted);
+                for (size_t i = 0; i < top_n; ++i)
+                {
+                    index[i] = result[i].index;
+                    similarity[i] = result[i].similarity;
+                }
+                return top_n;
+            }
+
+            template <typename T>
+            static size_t Write(StreamWriter &writer, const T &value)
+            {
+                return writer.write(reinterpret_cast<const char *>(&value), sizeof(T));
+            }
+
+            template <typename T>
+            static size_t Read(StreamReader &reader, T &value)
+            {
+                return reader.read(reinterpret_cast<char *>(&value), sizeof(T));
+            }
+
+            template <typename T>
+            static size_t Write(StreamWriter &writer, const T *arr, size_t size)
+            {
+                return writer.write(reinterpret_cast<const char *>(arr), sizeof(T) * size);
+            }
+
+            template <typename T>
+            static size_t Read(StreamReader &reader, T *arr, size_t size)
+            {
+                return reader.read(reinterpret_cast<char *>(arr), sizeof(T) * size);
+            }
+
+#define MAGIC_SERIAL 0x7726
+#define MAGIC_SERIAL_EXTENDED 0x7727    // rows are followed by sections of (uint32 id, uint64 bytes, payload), ended by id 0
+
+            enum Section : uint32_t
+            {
+                SECTION_END = 0,
+                SECTION_ROTATION = 1,   ///< dim x dim floats, stored rows are rotated
+                SECTION_TAGS = 2,       ///< (int32 tag, uint64 count, count x int64 index) for each tag
+                SECTION_IDENTITIES = 3, ///< (int64 index, int64 identity) for each bound face
+            };
+
+            bool Extended() const
+            {
+                return !m_rotation.empty() || !m_tags.empty() || !m_row_identity.empty();
+            }
+
+            void SaveSections(StreamWriter &writer) const
+            {
+                if (!m_rotation.empty())
+                {
+                    Write(writer, uint32_t(SECTION_ROTATION));
+                    Write(writer, uint64_t(m_rotation.size() * sizeof(float)));
+                    Write(writer, m_rotation.data(), m_rotation.size());
+                }
+                if (!m_tags.empty())
+                {
+                    uint64_t bytes = 0;
+                    for (auto &tag : m_tags) bytes += sizeof(int32_t) + sizeof(uint64_t) + tag.second.size() * sizeof(int64_t);
+                    Write(writer, uint32_t(SECTION_TAGS));
+                    Write(writer, bytes);
+                    std::vector<size_t> slots;
+                    std::vector<int64_t> indices;
+                    for (auto &tag : m_tags)
+                    {
+                        slots.clear();
+                        tag.second.slots(slots);
+                        indices.resize(slots.size());
+                        for (size_t i = 0; i < slots.size(); ++i) indices[i] = m_slot_index[slots[i]];
+                        Write(writer, tag.first);
+                        Write(writer, uint64_t(indices.size()));
+                        Write(writer, indices.data(), indices.size());
+                    }
+                }
+                if (!m_row_identity.empty())
+                {
+                    std::vector<int64_t> pairs;
+                    for (size_t row = 0; row < m_row_identity.size(); ++row)
+                    {
+                        for (auto slot : m_identity_slots[row])
+                        {
+                            pairs.push_back(m_slot_index[slot]);
+                            pairs.push_back(m_row_identity[row]);
+                        }
+                    }
+                    Write(writer, uint32_t(SECTION_IDENTITIES));
+                    Write(writer, uint64_t(pairs.size() * sizeof(int64_t)));
+                    Write(writer, pairs.data(), pairs.size());
+                }
+                Write(writer, uint32_t(SECTION_END));
+            }
+
+            bool LoadSections(StreamReader &reader)
+            {
+                while (true)
+                {
+                    uint32_t id = SECTION_END;
+                    if (Read(reader, id) != sizeof(id)) return false;
+                    if (id == SECTION_END) return true;
+                    uint64_t bytes;
+                    Read(reader, bytes);
+                    switch (id)
+                    {
+                    case SECTION_ROTATION:
+                        m_rotation.resize(size_t(bytes / sizeof(float)));
+                        Read(reader, m_rotation.data(), m_rotation.size());
+                        if (m_rotation.size() != m_dim * m_dim) return false;
+                        break;
+                    case SECTION_TAGS:
+                        while (bytes > 0)
+                        {
+                            int32_t tag;
+                            uint64_t count;
+                            Read(reader, tag);
+                            Read(reader, count);
+                            std::vector<int64_t> indices(static_cast<size_t>(count));
+                            Read(reader, indices.data(), indices.size());
+                            bytes -= std::min<uint64_t>(bytes, sizeof(tag) + sizeof(count) + count * sizeof(int64_t));
+                            auto &set = m_tags[tag];
+                            for (auto index : indices)
+                            {
+                                auto it = m_db.find(index);
+                                if (it != m_db.end()) set.insert(it->second);
+                            }
+                        }
+                        break;
+                    case SECTION_IDENTITIES:
+                    {
+                        std::vector<int64_t> pairs(static_cast<size_t>(bytes / sizeof(int64_t)));
+                        Read(reader, pairs.data(), pairs.size());
+                        for (size_t i = 0; i + 1 < pairs.size(); i += 2)
+                        {
+                            auto it = m_db.find(pairs[i]);
+                            if (it != m_db.end() && pairs[i + 1] >= 0) BindSlot(it->second, pairs[i + 1]);
+                        }
+                        break;
+                    }
+                    default:
+                    {
+                        // skip unknown section
+                        std::vector<char> skip(size_t(std::min<uint64_t>(bytes, 1 << 16)));
+                        while (bytes > 0)
+                        {
+                            auto step = size_t(std::min<uint64_t>(bytes, skip.size()));
+                            if (reader.read(skip.data(), step) != step) return false;
+                            bytes -= step;
+                        }
+                        break;
+                    }
+                    }
+                }
+            }
+
+            bool Save(StreamWriter &writer) const
+            {
+                unique_read_lock<MeteredRwMutex> _locker(m_db_mutex);
+                const int flag = Extended() ? MAGIC_SERIAL_EXTENDED : MAGIC_SERIAL;
+                Write(writer, flag);
+
+                const uint64_t num = m_db.size();
+                const uint64_t dim = m_dim;
+
+                Write(writer, num);
+                Write(writer, dim);
+
+                for (auto &line : m_db)
+                {
+                    auto &index = line.first;
+                    auto features = Row(line.second);
+                    // do save
+                    Write(writer, index);
+                    Write(writer, features, size_t(dim));
+                }
+                if (flag == MAGIC_SERIAL_EXTENDED)
+                {
+                    SaveSections(writer);
+                }
+                
+                orz::Log(orz::STATUS) << LOG_HEAD << "Saved " << num << " faces";
+
+                return true;
+            }
+
+            bool Load(StreamReader &reader)
+            {
+                unique_write_lock<MeteredRwMutex> _locker(m_db_mutex);
+
+                int flag;
+                Read(reader, flag);
+                if (flag != MAGIC_SERIAL && flag != MAGIC_SERIAL_EXTENDED) {
+                    orz::Log(orz::ERROR) << LOG_HEAD << "Load terminated, unsupported file format";
+                    return false;
+                }
+
+                uint64_t num;
+                uint64_t dim;
+                Read(reader, num);
+                Read(reader, dim);
+
+                if (dim != uint64_t(m_dim)) {
+                    orz::Log(orz::ERROR) << LOG_HEAD << "Load terminated, mismatch feature size";
+                    return false;
+                }
+
+                ClearStorage();
+                m_rotation.clear();
+                m_tags.clear();
+                m_max_index = -1;
+
+                m_slot_index.reserve(size_t(num));
+                m_features.reserve(size_t(num * dim));
+                size_t duplicates = 0;
+                for (size_t i = 0; i < num; ++i)
+                {
+                    int64_t index;
+                    Read(reader, index);
+
+                    // duplicated index overwrites its slot, last row wins like Register on same index
+                    auto it = m_db.find(index);
+                    auto slot = it != m_db.end() ? it->second : AcquireSlot(index);
+                    if (it != m_db.end()) ++duplicates;
+                    Read(reader, &m_features[slot * m_dim], size_t(dim));
+                    UpdateSignature(slot);
+
+                    m_max_index = std::max(m_max_index, index);
+                }
+                m_max_index++;
+                if (duplicates)
+                {
+                    orz::Log(orz::INFO) << LOG_HEAD << "Load found " << duplicates << " duplicated indexes, last rows kept";
+                }
+
+                if (flag == MAGIC_SERIAL_EXTENDED && !LoadSections(reader))
+                {
+                    orz::Log(orz::ERROR) << LOG_HEAD << "Load terminated, broken sections";
+                    ClearStorage();
+                    m_rotation.clear();
+                    m_tags.clear();
+                    m_max_index = 0;
+                    return false;
+                }
+
+                orz::Log(orz::STATUS) << LOG_HEAD << "Loaded " << m_db.size() << " faces";
+
+                return true;
+            }
+
+            int Tag(int64_t index, int32_t tag)
+            {
+                unique_write_lock<MeteredRwMutex> _locker(m_db_mutex);
+                auto it = m_db.find(index);
+                if (it == m_db.end()) return 0;
+                m_tags[tag].insert(it->second);
+                return 1;
+            }
+
+            int Untag(int64_t index, int32_t tag)
+            {
+                unique_write_lock<MeteredRwMutex> _locker(m_db_mutex);
+                auto it = m_db.find(index);
+                auto set = m_tags.find(tag);
+                if (it == m_db.end() || set == m_tags.end() || !set->second.contains(it->second)) return 0;
+                set->second.erase(it->second);
+                if (set->second.empty()) m_tags.erase(set);
+                return 1;
+            }
+
+            int Bind(int64_t index, int64_t identity)
+            {
+                if (identity < 0) return 0;
+                unique_write_lock<MeteredRwMutex> _locker(m_db_mutex);
+                auto it = m_db.find(index);
+                if (it == m_db.end()) return 0;
+                BindSlot(it->second, identity);
+                return 1;
+            }
+
+            int Unbind(int64_t index)
+            {
+                unique_write_lock<MeteredRwMutex> _locker(m_db_mutex);
+                auto it = m_db.find(index);
+                if (it == m_db.end() || m_slot_identity[it->second] < 0) return 0;
+                UnbindSlot(it->second);
+                return 1;
+            }
+
+            int64_t GetIdentity(int64_t index) const
+            {
+                unique_read_lock<MeteredRwMutex> _locker(m_db_mutex);
+                auto it = m_db.find(index);
+                if (it == m_db.end()) return -1;
+                return m_slot_identity[it->second];
+            }
+
+            bool LearnRotation()
+            {
+                // a rotation only keeps scores of an inner product compare op
+                if (m_main_core != nullptr && !m_main_core->IsInnerProductCompare())
+                {
+                    orz::Log(orz::ERROR) << LOG_HEAD << "Rotation needs features compared by inner product";
+                    return false;
+                }
+                unique_write_lock<MeteredRwMutex> _locker(m_db_mutex);
+                if (m_db.empty()) return false;
+
+                // second moment of evenly sampled rows, so leading axes hold most of the energy of inner products
+                const size_t samples = std::min(m_db.size(), std::max<size_t>(4096, 4 * m_dim));
+                const size_t step = m_db.size() / samples;
+                std::vector<double> moment;
+                size_t i = 0;
+                for (auto &line : m_db)
+                {
+                    if (i++ % step == 0) accumulate_moment(Row(line.second), m_dim, 1, int(m_dim), moment);
+                }
+
+                std::vector<float> rotation;
+                principal_axes(moment, int(m_dim), rotation);
+
+                ParallelSlots([&](size_t first, size_t second)
+                {
+                    std::vector<float> rotated(m_dim);
+                    for (size_t slot = first; slot < second; ++slot)
+                    {
+                        if (m_slot_index[slot] < 0) continue;
+                        rotate(rotation.data(), int(m_dim), Row(slot), rotated.data());
+                        std::memcpy(&m_features[slot * m_dim], rotated.data(), m_dim * sizeof(float));
+                        UpdateSignature(slot);
+                    }
+                });
+                for (size_t row = 0; row < m_row_identity.size(); ++row) UpdateCentroid(row);
+                ++m_generation;
+
+                if (m_rotation.empty())
+                {
+                    m_rotation = rotation;
+                }
+                else
+                {
+                    // compose with older rotation, new = rotation * older
+                    std::vector<float> composed(m_dim * m_dim);
+                    std::vector<float> column(m_dim), rotated(m_dim);
+                    for (size_t j = 0; j < m_dim; ++j)
+                    {
+                        for (size_t k = 0; k < m_dim; ++k) column[k] = m_rotation[k * m_dim + j];
+                        rotate(rotation.data(), int(m_dim), column.data(), rotated.data());
+                        for (size_t k = 0; k < m_dim; ++k) composed[k * m_dim + j] = rotated[k];
+                    }
+                    m_rotation.swap(composed);
+                }
+
+                orz::Log(orz::STATUS) << LOG_HEAD << "Learned rotation from " << samples << " faces";
+                return true;
+            }
+
+            /**
+             * \brief replace extraction cores and intra-op threads of each core, after all registrations finished
+             * \param cores 0 for keeping number of cores
+             * \param threads 0 for keeping threads of cores
+             * \note new submissions wait on m_cores_mutex meanwhile, so no task sees cores being replaced
+             */
+            void Configure(size_t cores, int threads)
+            {
+                if (!HasModel()) return;
+                unique_write_lock<rwmutex> _locker(m_cores_mutex);
+                JoinRegisteration();
+                if (cores == 0) cores = m_cores.size();
+                cores = std::max<size_t>(1, cores);
+                m_extraction_scheduler->resize(int(cores), cores * BULK_QUEUE_PER_CORE);
+                if (m_cores.size() < cores) CloneCores(cores);
+                m_cores.resize(cores);
+                if (threads > 0)
+                {
+                    for (auto &core : m_cores) core->set(FaceRecognizer::PROPERTY_NUMBER_THREADS, threads);
+                }
+                m_extraction_scheduler->reserve(ReservedCores(int(cores)));
+            }
+
+            /**
+             * \brief time TUNE_REQUESTS extractions of synthetic faces with current configuration
+             * \return requests per second for TUNE_THROUGHPUT, negative p99 latency in seconds for TUNE_P99_LATENCY, higher is better
+             */
+            double Benchmark(FaceDatabase::TuneTarget target, double qps)
+            {
+                using Clock = ExtractionScheduler::Clock;
+                const auto width = m_main_core->GetCropFaceWidthV2();
+                const auto height = m_main_core->GetCropFaceHeightV2();
+                const auto channels = m_main_core->GetCropFaceChannelsV2();
+                const auto bytes = size_t(width) * height * channels;
+                std::vector<unsigned char> pixels(TUNE_IMAGES * bytes);
+                std::mt19937 generator(5489);
+                for (auto &pixel : pixels) pixel = static_cast<unsigned char>(generator());
+                std::vector<float> features(TUNE_REQUESTS * m_dim);
+                std::vector<double> latencies(TUNE_REQUESTS);
+
+                auto submit = [&](size_t i, Clock::time_point issued)
+                {
+                    SeetaImageData image = { width, height, channels, &pixels[(i % TUNE_IMAGES) * bytes] };
+                    auto feature = &features[i * m_dim];
+                    auto latency = &latencies[i];
+                    Submit(ExtractionScheduler::INTERACTIVE, [this, image, feature, latency, issued](int id)
+                    {
+                        m_cores[id]->ExtractCroppedFace(image, feature);
+                        *latency = std::chrono::duration<double>(Clock::now() - issued).count();
+                    });
+                };
+
+                // first run of each core allocates its workspace
+                const auto cores = size_t(get(FaceDatabase::PROPERTY_EXTRACTION_CORES));
+                for (size_t i = 0; i < cores; ++i) submit(i % TUNE_REQUESTS, Clock::now());
+                m_extraction_scheduler->join();
+
+                const auto start = Clock::now();
+                for (size_t i = 0; i < TUNE_REQUESTS; ++i)
+                {
+                    auto issued = start;
+                    if (target == FaceDatabase::TUNE_P99_LATENCY)
+                    {
+                        // open loop, requests arrive at qps whatever the configuration keeps up or not
+                        issued += std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(i / qps));
+                        std::this_thread::sleep_until(issued);
+                    }
+                    submit(i, issued);
+                }
+                m_extraction_scheduler->join();
+                const auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+                if (target == FaceDatabase::TUNE_THROUGHPUT) return TUNE_REQUESTS / std::max(seconds, 1e-9);
+                const auto p99 = (TUNE_REQUESTS * 99 + 99) / 100 - 1;
+                std::nth_element(latencies.begin(), latencies.begin() + p99, latencies.end());
+                return -latencies[p99];
+            }
+
+#define MAGIC_TUNING 0x7742
+
+            /**
+             * \brief try extraction cores x intra-op threads within thread budget, apply the best
+             * \note budget is a partial one, executor workers bound cores x threads, the CPUs kept busy by extraction,
+             *  since a worker waits while its core runs on TenniS intra-op threads; those threads are created by TenniS
+             *  on top of the workers, and comparisons of queries share the same CPUs
+             */
+            bool Autotune(FaceDatabase::TuneTarget target, double qps, const char *path)
+            {
+                if (!HasModel()) return false;
+                if (target == FaceDatabase::TUNE_P99_LATENCY && qps <= 0)
+                {
+                    orz::Log(orz::ERROR) << LOG_HEAD << "Autotune for p99 latency needs qps > 0";
+                    return false;
+                }
+                if (target != FaceDatabase::TUNE_P99_LATENCY) qps = 0;
+                const auto budget = m_executor.size();
+
+                // header pins what configuration is tuned for, so a stale file is tuned again
+                struct
+                {
+                    int32_t magic;
+                    int32_t target;
+                    double qps;
+                    uint64_t budget;
+                    uint64_t dim;
+                    uint64_t cores;
+                    uint64_t threads;
+                } record = { MAGIC_TUNING, int32_t(target), qps, budget, m_dim, 0, 0 };
+
+                if (path != nullptr)
+                {
+                    std::ifstream input(path, std::ios::binary);
+                    auto loaded = record;
+                    if (input.read(reinterpret_cast<char *>(&loaded), sizeof(loaded)) &&
+                        loaded.magic == record.magic && loaded.target == record.target && loaded.qps == record.qps &&
+                        loaded.budget == record.budget && loaded.dim == record.dim &&
+                        loaded.cores >= 1 && loaded.cores <= budget && loaded.threads >= 1)
+                    {
+                        Configure(size_t(loaded.cores), int(loaded.threads));
+                        orz::Log(orz::STATUS) << LOG_HEAD << "Loaded tuning " << loaded.cores << " cores x " << loaded.threads << " threads from " << path;
+                        return true;
+                    }
+                }
+
+                // first core is kept by Configure, and its cache is shared with clones
+                const auto cache_size = m_main_core->get(FaceRecognizer::PROPERTY_EXTRACTION_CACHE_SIZE);
+                m_main_core->set(FaceRecognizer::PROPERTY_EXTRACTION_CACHE_SIZE, 0);
+
+                double best_score = -DBL_MAX;
+                size_t best_cores = 1;
+                int best_threads = 1;
+                std::vector<size_t> candidates;
+                for (size_t cores = 1; cores < budget; cores *= 2) candidates.push_back(cores);
+                candidates.push_back(budget);
+                for (auto cores : candidates)
                 {
-                    if (data[sorted_size].similarity < threshold) break;
+                    for (size_t threads = 1; cores * threads <= budget; threads *= 2)
+                    {
+                        Configure(cores, int(threads));
+                        const auto score = Benchmark(target, qps);
+                        orz::Log(orz::STATUS) << LOG_HEAD << "Autotune " << cores << " cores x " << threads << " threads: " << std::abs(score)
+                                              << (target == FaceDatabase::TUNE_THROUGHPUT ? " faces/s" : " s p99");
+                        if (score > best_score)
+                        {
+                            best_score = score;
+                            best_cores = cores;
+                            best_threads = int(threads);
+                        }
+                    }
                 }
 
-                return size_t(sorted_size);
-            }
-
-            size_t QueryAbove(const float *features, float threshold, size_t N, int64_t* index, float* similarity) const
-            {
-                unique_read_lock<rwmutex> _read_locker(m_db_mutex);
+                Configure(best_cores, best_threads);
+                m_main_core->set(FaceRecognizer::PROPERTY_EXTRACTION_CACHE_SIZE, cache_size);
+                orz::Log(orz::STATUS) << LOG_HEAD << "Autotune picked " << best_cores << " cores x " << best_threads << " threads, "
+                                      << budget + best_cores * size_t(best_threads) << " threads with executor workers";
 
-                std::vector<IndexWithSimilarity> result(m_db.size());
+                if (path != nullptr)
                 {
-                    std::unique_lock<std::mutex> _locker(m_comparation_mutex);
-                    size_t i = 0;
-                    for (auto &line : m_db)
+                    record.cores = best_cores;
+                    record.threads = uint64_t(best_threads);
+                    std::ofstream output(path, std::ios::binary | std::ios::trunc);
+                    if (!output.write(reinterpret_cast<const char *>(&record), sizeof(record)))
                     {
-                        result[i].index = line.first;
-                        CompareParallel(features, line.second.get(), &result[i].similarity);
-                        i++;
+                        orz::Log(orz::ERROR) << LOG_HEAD << "Can not save tuning to " << path;
                     }
-                    JoinComparation();
-                }
-                // sort all above threshold
-                size_t sorted = SortAbove(result.data(), m_db.size(), threshold);
-                const size_t top_n = std::min(N, sorted);
-                for (size_t i = 0; i < top_n; ++i)
-                {
-                    index[i] = result[i].index;
-                    similarity[i] = result[i].similarity;
                 }
-                return top_n;
+                return true;
             }
 
-            template <typename T>
-            static size_t Write(StreamWriter &writer, const T &value)
+            void set(FaceDatabase::Property property, double value)
             {
-                return writer.write(reinterpret_cast<const char *>(&value), sizeof(T));
+                // reconfiguring waits registrations, which take the database lock
+                if (property == FaceDatabase::PROPERTY_EXTRACTION_CORES)
+                {
+                    Configure(value < 1 ? 1 : size_t(value), 0);
+                    return;
+                }
+                if (property == FaceDatabase::PROPERTY_CORE_THREADS)
+                {
+                    Configure(0, value < 1 ? 1 : int(value));
+                    return;
+                }
+                unique_write_lock<MeteredRwMutex> _locker(m_db_mutex);
+                switch (property)
+                {
+                default:
+                    break;
+                case FaceDatabase::PROPERTY_PREFILTER_CANDIDATES:
+                    m_prefilter_candidates = value < 1 ? 0 : size_t(value);
+                    break;
+                case FaceDatabase::PROPERTY_AGGREGATION_TOP_K:
+                    m_aggregation_top_k = value < 1 ? 1 : size_t(value);
+                    break;
+                case FaceDatabase::PROPERTY_CENTROID_CANDIDATES:
+                    m_centroid_candidates = value < 1 ? 0 : size_t(value);
+                    break;
+                case FaceDatabase::PROPERTY_SOFTMAX_TEMPERATURE:
+                    if (value > 0) m_softmax_temperature = value;
+                    break;
+                case FaceDatabase::PROPERTY_RESERVED_EXTRACTION_CORES:
+                    m_extraction_scheduler->reserve(value < 1 ? 0 : int(value));
+                    break;
+                }
             }
 
-            template <typename T>
-            static size_t Read(StreamReader &reader, T &value)
+            double get(FaceDatabase::Property property) const
             {
-                return reader.read(reinterpret_cast<char *>(&value), sizeof(T));
+                // core properties take m_cores_mutex alone, see lock order at m_cores_mutex
+                if (property == FaceDatabase::PROPERTY_EXTRACTION_CORES)
+                {
+                    unique_read_lock<rwmutex> _locker(m_cores_mutex);
+                    return double(m_cores.size());
+                }
+                if (property == FaceDatabase::PROPERTY_CORE_THREADS)
+                {
+                    unique_read_lock<rwmutex> _locker(m_cores_mutex);
+                    if (m_cores.empty()) return 0;
+                    return m_cores[0]->get(FaceRecognizer::PROPERTY_NUMBER_THREADS);
+                }
+                unique_read_lock<MeteredRwMutex> _locker(m_db_mutex);
+                switch (property)
+                {
+                default:
+                    return 0;
+                case FaceDatabase::PROPERTY_PREFILTER_CANDIDATES:
+                    return double(m_prefilter_candidates);
+                case FaceDatabase::PROPERTY_AGGREGATION_TOP_K:
+                    return double(m_aggregation_top_k);
+                case FaceDatabase::PROPERTY_CENTROID_CANDIDATES:
+                    return double(m_centroid_candidates);
+                case FaceDatabase::PROPERTY_SOFTMAX_TEMPERATURE:
+                    return m_softmax_temperature;
+                case FaceDatabase::PROPERTY_BUFFER_ALLOCATIONS:
+                    return double(BufferPool::Global().allocations());
+                case FaceDatabase::PROPERTY_BUFFER_REUSES:
+                    return double(BufferPool::Global().reuses());
+                case FaceDatabase::PROPERTY_RESERVED_EXTRACTION_CORES:
+                    return double(m_extraction_scheduler->reserved());
+                case FaceDatabase::PROPERTY_EXPIRED_REGISTRATIONS:
+                    return double(m_extraction_scheduler->expired());
+                }
             }
 
             template <typename T>
-            static size_t Write(StreamWriter &writer, const T *arr, size_t size)
+            static size_t Bytes(const std::vector<T> &values)
             {
-                return writer.write(reinterpret_cast<const char *>(arr), sizeof(T) * size);
+                return values.capacity() * sizeof(T);
             }
 
-            template <typename T>
-            static size_t Read(StreamReader &reader, T *arr, size_t size)
+            /**
+             * \brief approximate, red-black tree nodes take value and about four pointers
+             */
+            template <typename K, typename V>
+            static size_t Bytes(const std::map<K, V> &values)
             {
-                return reader.read(reinterpret_cast<char *>(arr), sizeof(T) * size);
+                return values.size() * (sizeof(typename std::map<K, V>::value_type) + 4 * sizeof(void *));
             }
 
-#define MAGIC_SERIAL 0x7726
-
-            bool Save(StreamWriter &writer) const
+            /**
+             * \brief all metrics in Prometheus text exposition format
+             */
+            std::string Metrics() const
             {
-                unique_read_lock<rwmutex> _locker(m_db_mutex);
-                const int flag = MAGIC_SERIAL;
-                Write(writer, flag);
-
-                const uint64_t num = m_db.size();
-                const uint64_t dim = m_main_core->GetExtractFeatureSize();
-
-                Write(writer, num);
-                Write(writer, dim);
+                const std::string prefix = "seeta_face_database_";
+                std::ostringstream out;
+                auto head = [&](const char *name, const char *type, const char *help)
+                {
+                    out << "# HELP " << prefix << name << " " << help << "\n";
+                    out << "# TYPE " << prefix << name << " " << type << "\n";
+                };
 
-                for (auto &line : m_db)
+                head("query_duration_seconds", "histogram", "Query latency including lock wait, by query type.");
+                for (int query = 0; query < DatabaseMetrics::QUERIES; ++query)
                 {
-                    auto &index = line.first;
-                    auto &features = line.second;
-                    // do save
-                    Write(writer, index);
-                    Write(writer, features.get(), size_t(dim));
+                    const auto type = DatabaseMetrics::Name(DatabaseMetrics::Query(query));
+                    m_metrics.query_latency[query].write(out, prefix + "query_duration_seconds", std::string("type=\"") + type + "\"");
                 }
-                
-                orz::Log(orz::STATUS) << LOG_HEAD << "Loaded " << num << " faces";
-
-                return true;
-            }
-
-            bool Load(StreamReader &reader)
-            {
-                unique_write_lock<rwmutex> _locker(m_db_mutex);
-
-                int flag;
-                Read(reader, flag);
-                if (flag != MAGIC_SERIAL) {
-                    orz::Log(orz::ERROR) << LOG_HEAD << "Load terminated, unsupported file format";
-                    return false;
+                head("query_rows_scanned_total", "counter", "Rows compared with full features, by query type.");
+                for (int query = 0; query < DatabaseMetrics::QUERIES; ++query)
+                {
+                    out << prefix << "query_rows_scanned_total{type=\"" << DatabaseMetrics::Name(DatabaseMetrics::Query(query)) << "\"} "
+                        << m_metrics.query_rows[query].load(std::memory_order_relaxed) << "\n";
                 }
-
-                uint64_t num;
-                uint64_t dim;
-                Read(reader, num);
-                Read(reader, dim);
-
-                if (m_main_core != nullptr)
+                head("insert_duration_seconds", "histogram", "Row insertion latency including lock wait and standing queries.");
+                m_metrics.insert_latency.write(out, prefix + "insert_duration_seconds", "");
+                head("lock_wait_seconds", "histogram", "Wait for the database lock, by mode.");
+                m_metrics.read_lock_wait.write(out, prefix + "lock_wait_seconds", "mode=\"read\"");
+                m_metrics.write_lock_wait.write(out, prefix + "lock_wait_seconds", "mode=\"write\"");
+                head("registrations_total", "counter", "Rows inserted, rate() gives registrations per second.");
+                out << prefix << "registrations_total " << m_metrics.registrations.load(std::memory_order_relaxed) << "\n";
+                head("registration_failures_total", "counter", "Parallel registrations given index -1 for failed extraction or missed deadline.");
+                out << prefix << "registration_failures_total " << m_metrics.registration_failures.load(std::memory_order_relaxed) << "\n";
+
+                head("extraction_queued", "gauge", "Registrations waiting for an extraction core, by priority.");
+                out << prefix << "extraction_queued{priority=\"interactive\"} " << m_extraction_scheduler->queued(ExtractionScheduler::INTERACTIVE) << "\n";
+                out << prefix << "extraction_queued{priority=\"bulk\"} " << m_extraction_scheduler->queued(ExtractionScheduler::BULK) << "\n";
+                head("extraction_running", "gauge", "Extractions in progress, by priority.");
+                out << prefix << "extraction_running{priority=\"interactive\"} " << m_extraction_scheduler->running(ExtractionScheduler::INTERACTIVE) << "\n";
+                out << prefix << "extraction_running{priority=\"bulk\"} " << m_extraction_scheduler->running(ExtractionScheduler::BULK) << "\n";
+                head("expired_registrations_total", "counter", "Bulk registrations dropped for missing their deadline.");
+                out << prefix << "expired_registrations_total " << m_extraction_scheduler->expired() << "\n";
+                head("insertion_queued", "gauge", "Extracted features waiting for insertion, by priority.");
+                out << prefix << "insertion_queued{priority=\"interactive\"} " << InsertionQueue(ExtractionScheduler::INTERACTIVE).size() << "\n";
+                out << prefix << "insertion_queued{priority=\"bulk\"} " << InsertionQueue(ExtractionScheduler::BULK).size() << "\n";
+                head("alert_queued", "gauge", "Standing query matches waiting for their callback.");
+                out << prefix << "alert_queued " << m_alert_queue.size() << "\n";
+                head("executor_pending", "gauge", "Tasks posted to workers shared by all databases and not started yet.");
+                out << prefix << "executor_pending " << m_executor.pending() << "\n";
+                head("executor_workers", "gauge", "Workers shared by all databases.");
+                out << prefix << "executor_workers " << m_executor.size() << "\n";
+                head("buffer_allocations_total", "counter", "Request buffers taken from system by all databases.");
+                out << prefix << "buffer_allocations_total " << BufferPool::Global().allocations() << "\n";
+                head("buffer_reuses_total", "counter", "Request buffers served from pool.");
+                out << prefix << "buffer_reuses_total " << BufferPool::Global().reuses() << "\n";
+
+                std::vector<std::pair<const char *, size_t>> memory;
+                size_t faces, identities;
                 {
-                    if (dim != uint64_t(m_main_core->GetExtractFeatureSize())) {
-                        orz::Log(orz::ERROR) << LOG_HEAD << "Load terminated, mismatch feature size";
-                        return false;
-                    }
+                    unique_read_lock<MeteredRwMutex> _locker(m_db_mutex);
+                    faces = m_db.size();
+                    identities = m_row_identity.size();
+                    size_t tags = Bytes(m_tags);
+                    for (auto &tag : m_tags) tags += tag.second.bytes();
+                    size_t identity_slots = Bytes(m_identity_slots);
+                    for (auto &slots : m_identity_slots) identity_slots += Bytes(slots);
+                    memory.emplace_back("features", Bytes(m_features));
+                    memory.emplace_back("index", Bytes(m_db));
+                    memory.emplace_back("slots", Bytes(m_slot_index) + Bytes(m_free_slots));
+                    memory.emplace_back("signatures", Bytes(m_signatures));
+                    memory.emplace_back("tail_norms", Bytes(m_tail_norms));
+                    memory.emplace_back("rotation", Bytes(m_rotation));
+                    memory.emplace_back("tags", tags);
+                    memory.emplace_back("identities", Bytes(m_slot_identity) + Bytes(m_identity_rows) + Bytes(m_row_identity) + identity_slots);
+                    memory.emplace_back("centroids", Bytes(m_centroids));
                 }
-
-                m_db.clear();
-                m_max_index = -1;
-
-                for (size_t i = 0; i < num; ++i)
                 {
-                    int64_t index;
-                    std::shared_ptr<float> features(new float[size_t(dim)], std::default_delete<float[]>());
-
-                    Read(reader, index);
-                    Read(reader, features.get(), size_t(dim));
-
-                    m_db.insert(std::make_pair(index, features));
-                    m_max_index = std::max(m_max_index, index);
+                    unique_read_lock<rwmutex> _locker(m_standing_mutex);
+                    memory.emplace_back("standing_queries", Bytes(m_standing_probes) + Bytes(m_standing_ids) + Bytes(m_standing_thresholds));
                 }
-                m_max_index++;
-
-                orz::Log(orz::STATUS) << LOG_HEAD << "Loaded " << num << " faces";
-
-                return true;
+                head("faces", "gauge", "Faces stored.");
+                out << prefix << "faces " << faces << "\n";
+                head("identities", "gauge", "Identities having templates.");
+                out << prefix << "identities " << identities << "\n";
+                head("memory_bytes", "gauge", "Heap bytes held, by component; index and tags are estimated.");
+                for (auto &component : memory)
+                {
+                    out << prefix << "memory_bytes{component=\"" << component.first << "\"} " << component.second << "\n";
+                }
+                return out.str();
             }
 
             seeta::FaceRecognizer *ExtractionCore(int id = 0)
             {
+                unique_read_lock<rwmutex> _locker(m_cores_mutex);
                 if (id < 0 || size_t(id) >= m_cores.size())
                 {
                     return nullptr;
@@ -438,17 +2240,67 @@ namespace seeta
             }
 
 		private:
-            std::shared_ptr<seeta::FaceRecognizer> m_main_core;
+            std::shared_ptr<seeta::FaceRecognizer> m_main_core;    ///< nullptr for model-free database
+            kernel::FeatureKernel m_kernel; ///< compares rows of model-free database
             std::vector<std::shared_ptr<seeta::FaceRecognizer>> m_cores;
-            std::shared_ptr<orz::Shotgun> m_extraction_gun;
-            std::shared_ptr<orz::Shotgun> m_comparation_gun;
-
-            mutable std::map<int64_t, std::shared_ptr<float>> m_db; // saving face db
+            /**
+             * write locked by Configure replacing m_cores, read locked by submissions and readers.
+             * Lock order is m_cores_mutex before m_db_mutex, never the reverse: Configure waits insertions,
+             * which take m_db_mutex, so m_cores_mutex must not be taken while m_db_mutex is held.
+             */
+            mutable rwmutex m_cores_mutex;
+            Executor &m_executor = Executor::Global();   ///< workers shared with all databases
+            std::shared_ptr<ExtractionScheduler> m_extraction_scheduler;
+            static const int RESERVED_CORE_RATIO = 4;   ///< one in such many extraction cores only serves queries and interactive registrations, see ReservedCores
+            static const size_t BULK_QUEUE_PER_CORE = 4;    ///< queued bulk crops of each extraction core before RegisterBulkParallel blocks
+            static const size_t TUNE_REQUESTS = 64; ///< timed extractions of each autotune candidate
+            static const size_t TUNE_IMAGES = 8;    ///< distinct synthetic faces cycled by autotune
+            size_t m_comparation_width = 1; ///< blocks of one parallel comparison
+
+            size_t m_dim = 0;   ///< feature size of each row
+            mutable std::map<int64_t, size_t> m_db; // saving face db, index to slot
+            mutable std::vector<float> m_features;  ///< slot-major rows, m_dim floats per slot
+            mutable std::vector<int64_t> m_slot_index;  ///< index of each slot, -1 for free slot
+            mutable std::vector<size_t> m_free_slots;
+            size_t m_signature_words = 0;   ///< uint64 words of each signature
+            mutable std::vector<uint64_t> m_signatures;  ///< slot-major sign bits of rows, for prefilter
+            size_t m_prefilter_candidates = 0;  ///< 0 for exhaustive scan
+
+            static const size_t ABANDON_BLOCK = 32;  ///< dims scanned between two early-abandon checks
+            size_t m_tail_blocks = 0;
+            mutable std::vector<float> m_tail_norms;    ///< slot-major, norm of each row from block b to the end
+            std::vector<float> m_rotation;  ///< dim x dim orthogonal rotation of stored rows, empty for none
+
+            mutable std::map<int32_t, SlotSet> m_tags; ///< partition tag to tagged slots
+
+            mutable std::vector<int64_t> m_slot_identity;   ///< identity of each slot, -1 for none
+            mutable std::map<int64_t, size_t> m_identity_rows;  ///< identity to identity row
+            mutable std::vector<int64_t> m_row_identity;    ///< identity of each identity row
+            mutable std::vector<std::vector<size_t>> m_identity_slots;  ///< template slots of each identity row
+            mutable std::vector<float> m_centroids; ///< row-major, normalized mean of templates of each identity row
+            size_t m_aggregation_top_k = 3;
+            size_t m_centroid_candidates = 0;   ///< 0 for expanding all identities
+            double m_softmax_temperature = 0.1;
+
+            static const size_t PROBE_TILE = 64;    ///< rows scored by all probes before moving on
+            static const size_t PAIR_BLOCK = 128;   ///< rows and columns of one all-pairs tile
+            static const size_t PAIR_FLUSH = 1 << 16;   ///< pairs buffered by one worker before emitted
+            static const int WHISPERS_ITERATIONS = 20;
             mutable int64_t m_max_index = 0;    ///< next saving id 
-
-            mutable rwmutex m_db_mutex;
-            mutable std::mutex m_comparation_mutex;
-            orz::Canyon m_insertion_queue;
+            mutable uint64_t m_generation = 0;  ///< bumped when stored rows are removed or rewritten, appending keeps it
+
+            std::vector<float> m_standing_probes;   ///< row-major, m_dim floats per standing query
+            std::vector<int64_t> m_standing_ids;
+            std::vector<float> m_standing_thresholds;
+            int64_t m_standing_max_id = 0;
+            FaceDatabase::StandingCallback m_standing_callback;
+            mutable rwmutex m_standing_mutex;
+
+            mutable DatabaseMetrics m_metrics;
+            mutable MeteredRwMutex m_db_mutex{m_metrics};   ///< lock waits are recorded into m_metrics
+            Executor::Strand m_insertion_queue{m_executor};  ///< interactive insertions
+            Executor::Strand m_bulk_insertion_queue{m_executor};
+            Executor::Strand m_alert_queue{m_executor};  ///< runs standing query callbacks, off the insertion path
 		};
 	}
 }
@@ -466,6 +2318,12 @@ seeta::FaceDatabase::FaceDatabase(const SeetaModelSetting& setting, int extracti
 {
 }
 
+seeta::FaceDatabase::FaceDatabase(int feature_size, int comparation_core_number)
+    : m_impl(new Implement(feature_size > 1 ? feature_size : 1,
+    comparation_core_number > 1 ? comparation_core_number : 1))
+{
+}
+
 seeta::FaceDatabase::~FaceDatabase()
 {
     delete m_impl;
@@ -476,6 +2334,16 @@ int seeta::FaceDatabase::SetLogLevel(int level)
 	return orz::GlobalLogLevel(orz::LogLevel(level));
 }
 
+int seeta::FaceDatabase::SetThreadBudget(int threads)
+{
+    return int(Executor::SetBudget(threads > 0 ? size_t(threads) : 0));
+}
+
+int seeta::FaceDatabase::SetNumaPlacement(bool enabled)
+{
+    return int(Executor::SetPlacement(enabled));
+}
+
 int seeta::FaceDatabase::GetCropFaceWidthV2()
 {
     return 256;
@@ -517,35 +2385,45 @@ bool seeta::FaceDatabase::CropFaceV2(const SeetaImageData& image, const SeetaPoi
 float seeta::FaceDatabase::Compare(const SeetaImageData& image1, const SeetaPointF* points1,
     const SeetaImageData& image2, const SeetaPointF* points2) const
 {
-    auto feature_size = m_impl->core().GetExtractFeatureSize();
-    std::unique_ptr<float[]> features(new float[2 * feature_size]);
+    auto feature_size = m_impl->dim();
+    PooledArray<float> features(2 * feature_size);
     auto cart1 = m_impl->ExtractParallel(image1, points1, features.get());
     if (cart1 == nullptr) return 0;
     auto cart2 = m_impl->ExtractParallel(image2, points2, features.get() + feature_size);
-    if (cart2 == nullptr) return 0;
+    if (cart2 == nullptr)
+    {
+        // features is pooled, so it must outlive the first extraction
+        cart1->join();
+        return 0;
+    }
     cart1->join();
     cart2->join();
-    return m_impl->core().CalculateSimilarity(features.get(), features.get() + feature_size);
+    return m_impl->Similarity(features.get(), features.get() + feature_size);
 }
 
 float seeta::FaceDatabase::CompareByCroppedFace(const SeetaImageData& cropped_face_image1,
     const SeetaImageData& cropped_face_image2) const
 {
-    auto feature_size = m_impl->core().GetExtractFeatureSize();
-    std::unique_ptr<float[]> features(new float[2 * feature_size]);
+    auto feature_size = m_impl->dim();
+    PooledArray<float> features(2 * feature_size);
     auto cart1 = m_impl->ExtractCroppedFaceParallel(cropped_face_image1, features.get());
     if (cart1 == nullptr) return 0;
     auto cart2 = m_impl->ExtractCroppedFaceParallel(cropped_face_image2, features.get() + feature_size);
-    if (cart2 == nullptr) return 0;
+    if (cart2 == nullptr)
+    {
+        // features is pooled, so it must outlive the first extraction
+        cart1->join();
+        return 0;
+    }
     cart1->join();
     cart2->join();
-    return m_impl->core().CalculateSimilarity(features.get(), features.get() + feature_size);
+    return m_impl->Similarity(features.get(), features.get() + feature_size);
 }
 
 int64_t seeta::FaceDatabase::Register(const SeetaImageData& image, const SeetaPointF* points)
 {
-    auto feature_size = m_impl->core().GetExtractFeatureSize();
-    std::shared_ptr<float> features(new float[feature_size], std::default_delete<float[]>());
+    auto feature_size = m_impl->dim();
+    auto features = BufferPool::Global().shared<float>(size_t(feature_size));
     auto cart_extraction = m_impl->ExtractParallel(image, points, features.get());
     if (cart_extraction == nullptr) return -1;
     cart_extraction->join();
@@ -555,8 +2433,8 @@ int64_t seeta::FaceDatabase::Register(const SeetaImageData& image, const SeetaPo
 
 int64_t seeta::FaceDatabase::RegisterByCroppedFace(const SeetaImageData& cropped_face_image)
 {
-    auto feature_size = m_impl->core().GetExtractFeatureSize();
-    std::shared_ptr<float> features(new float[feature_size], std::default_delete<float[]>());
+    auto feature_size = m_impl->dim();
+    auto features = BufferPool::Global().shared<float>(size_t(feature_size));
     auto cart_extraction = m_impl->ExtractCroppedFaceParallel(cropped_face_image, features.get());
     if (cart_extraction == nullptr) return -1;
     cart_extraction->join();
@@ -564,6 +2442,12 @@ int64_t seeta::FaceDatabase::RegisterByCroppedFace(const SeetaImageData& cropped
     return index;
 }
 
+int64_t seeta::FaceDatabase::RegisterByFeatures(const float* features)
+{
+    if (!features) return -1;
+    return m_impl->Insert(features);
+}
+
 int seeta::FaceDatabase::Delete(int64_t index)
 {
     return m_impl->Delete(index);
@@ -603,11 +2487,11 @@ size_t seeta::FaceDatabase::QueryTop(const SeetaImageData& image, const SeetaPoi
     float* similarity) const
 {
     if (!index || !similarity) return 0;
-    this->Join();
+    m_impl->JoinRegisteration(ExtractionScheduler::INTERACTIVE);
     const auto count = this->Count();
     if (count == 0) return 0;
-    const auto feature_size = m_impl->core().GetExtractFeatureSize();
-    std::unique_ptr<float[]> features(new float[feature_size]);
+    const auto feature_size = m_impl->dim();
+    PooledArray<float> features(feature_size);
     auto cart_extraction = m_impl->ExtractParallel(image, points, features.get());
     if (cart_extraction == nullptr) return 0;
     cart_extraction->join();
@@ -618,26 +2502,35 @@ size_t seeta::FaceDatabase::QueryTopByCroppedFace(const SeetaImageData& cropped_
     float* similarity) const
 {
     if (!index || !similarity) return 0;
-    this->Join();
+    m_impl->JoinRegisteration(ExtractionScheduler::INTERACTIVE);
     const auto count = this->Count();
     if (count == 0) return 0;
-    const auto feature_size = m_impl->core().GetExtractFeatureSize();
-    std::unique_ptr<float[]> features(new float[feature_size]);
+    const auto feature_size = m_impl->dim();
+    PooledArray<float> features(feature_size);
     auto cart_extraction = m_impl->ExtractCroppedFaceParallel(cropped_face_image, features.get());
     if (cart_extraction == nullptr) return 0;
     cart_extraction->join();
     return m_impl->QueryTop(features.get(), N, index, similarity);
 }
 
+size_t seeta::FaceDatabase::QueryTopByFeatures(const float* features, size_t N, int64_t* index, float* similarity) const
+{
+    if (!features || !index || !similarity) return 0;
+    m_impl->JoinRegisteration(ExtractionScheduler::INTERACTIVE);
+    const auto count = this->Count();
+    if (count == 0) return 0;
+    return m_impl->QueryTop(features, N, index, similarity);
+}
+
 size_t seeta::FaceDatabase::QueryAbove(const SeetaImageData& image, const SeetaPointF* points, float threshold, size_t N,
     int64_t* index, float* similarity) const
 {
     if (!index || !similarity) return 0;
-    this->Join();
+    m_impl->JoinRegisteration(ExtractionScheduler::INTERACTIVE);
     const auto count = this->Count();
     if (count == 0) return 0;
-    const auto feature_size = m_impl->core().GetExtractFeatureSize();
-    std::unique_ptr<float[]> features(new float[feature_size]);
+    const auto feature_size = m_impl->dim();
+    PooledArray<float> features(feature_size);
     auto cart_extraction = m_impl->ExtractParallel(image, points, features.get());
     if (cart_extraction == nullptr) return 0;
     cart_extraction->join();
@@ -648,17 +2541,199 @@ size_t seeta::FaceDatabase::QueryAboveByCroppedFace(const SeetaImageData& croppe
     int64_t* index, float* similarity) const
 {
     if (!index || !similarity) return 0;
-    this->Join();
+    m_impl->JoinRegisteration(ExtractionScheduler::INTERACTIVE);
     const auto count = this->Count();
     if (count == 0) return 0;
-    const auto feature_size = m_impl->core().GetExtractFeatureSize();
-    std::unique_ptr<float[]> features(new float[feature_size]);
+    const auto feature_size = m_impl->dim();
+    PooledArray<float> features(feature_size);
     auto cart_extraction = m_impl->ExtractCroppedFaceParallel(cropped_face_image, features.get());
     if (cart_extraction == nullptr) return 0;
     cart_extraction->join();
     return m_impl->QueryAbove(features.get(), threshold, N, index, similarity);
 }
 
+size_t seeta::FaceDatabase::QueryAboveByFeatures(const float* features, float threshold, size_t N, int64_t* index,
+    float* similarity) const
+{
+    if (!features || !index || !similarity) return 0;
+    m_impl->JoinRegisteration(ExtractionScheduler::INTERACTIVE);
+    const auto count = this->Count();
+    if (count == 0) return 0;
+    return m_impl->QueryAbove(features, threshold, N, index, similarity);
+}
+
+int seeta::FaceDatabase::Tag(int64_t index, int32_t tag)
+{
+    return m_impl->Tag(index, tag);
+}
+
+int seeta::FaceDatabase::Untag(int64_t index, int32_t tag)
+{
+    return m_impl->Untag(index, tag);
+}
+
+size_t seeta::FaceDatabase::QueryTopInPartition(const SeetaImageData& image, const SeetaPointF* points,
+    const int32_t* tags, size_t tag_count, size_t N, int64_t* index, float* similarity) const
+{
+    if (!index || !similarity) return 0;
+    m_impl->JoinRegisteration(ExtractionScheduler::INTERACTIVE);
+    const auto count = this->Count();
+    if (count == 0) return 0;
+    const auto feature_size = m_impl->dim();
+    PooledArray<float> features(feature_size);
+    auto cart_extraction = m_impl->ExtractParallel(image, points, features.get());
+    if (cart_extraction == nullptr) return 0;
+    cart_extraction->join();
+    return m_impl->QueryTop(features.get(), N, index, similarity, tags, tag_count);
+}
+
+size_t seeta::FaceDatabase::QueryTopByCroppedFaceInPartition(const SeetaImageData& cropped_face_image,
+    const int32_t* tags, size_t tag_count, size_t N, int64_t* index, float* similarity) const
+{
+    if (!index || !similarity) return 0;
+    m_impl->JoinRegisteration(ExtractionScheduler::INTERACTIVE);
+    const auto count = this->Count();
+    if (count == 0) return 0;
+    const auto feature_size = m_impl->dim();
+    PooledArray<float> features(feature_size);
+    auto cart_extraction = m_impl->ExtractCroppedFaceParallel(cropped_face_image, features.get());
+    if (cart_extraction == nullptr) return 0;
+    cart_extraction->join();
+    return m_impl->QueryTop(features.get(), N, index, similarity, tags, tag_count);
+}
+
+size_t seeta::FaceDatabase::QueryAboveInPartition(const SeetaImageData& image, const SeetaPointF* points,
+    const int32_t* tags, size_t tag_count, float threshold, size_t N, int64_t* index, float* similarity) const
+{
+    if (!index || !similarity) return 0;
+    m_impl->JoinRegisteration(ExtractionScheduler::INTERACTIVE);
+    const auto count = this->Count();
+    if (count == 0) return 0;
+    const auto feature_size = m_impl->dim();
+    PooledArray<float> features(feature_size);
+    auto cart_extraction = m_impl->ExtractParallel(image, points, features.get());
+    if (cart_extraction == nullptr) return 0;
+    cart_extraction->join();
+    return m_impl->QueryAbove(features.get(), threshold, N, index, similarity, tags, tag_count);
+}
+
+size_t seeta::FaceDatabase::QueryAboveByCroppedFaceInPartition(const SeetaImageData& cropped_face_image,
+    const int32_t* tags, size_t tag_count, float threshold, size_t N, int64_t* index, float* similarity) const
+{
+    if (!index || !similarity) return 0;
+    m_impl->JoinRegisteration(ExtractionScheduler::INTERACTIVE);
+    const auto count = this->Count();
+    if (count == 0) return 0;
+    const auto feature_size = m_impl->dim();
+    PooledArray<float> features(feature_size);
+    auto cart_extraction = m_impl->ExtractCroppedFaceParallel(cropped_face_image, features.get());
+    if (cart_extraction == nullptr) return 0;
+    cart_extraction->join();
+    return m_impl->QueryAbove(features.get(), threshold, N, index, similarity, tags, tag_count);
+}
+
+int seeta::FaceDatabase::Bind(int64_t index, int64_t identity)
+{
+    return m_impl->Bind(index, identity);
+}
+
+int seeta::FaceDatabase::Unbind(int64_t index)
+{
+    return m_impl->Unbind(index);
+}
+
+int64_t seeta::FaceDatabase::GetIdentity(int64_t index) const
+{
+    return m_impl->GetIdentity(index);
+}
+
+size_t seeta::FaceDatabase::QueryTopIdentities(const SeetaImageData& image, const SeetaPointF* points,
+    Aggregation aggregation, size_t N, int64_t* identity, float* similarity) const
+{
+    if (!identity || !similarity) return 0;
+    m_impl->JoinRegisteration(ExtractionScheduler::INTERACTIVE);
+    const auto count = this->Count();
+    if (count == 0) return 0;
+    const auto feature_size = m_impl->dim();
+    PooledArray<float> features(feature_size);
+    auto cart_extraction = m_impl->ExtractParallel(image, points, features.get());
+    if (cart_extraction == nullptr) return 0;
+    cart_extraction->join();
+    return m_impl->QueryTopIdentities(features.get(), aggregation, N, identity, similarity);
+}
+
+size_t seeta::FaceDatabase::QueryTopIdentitiesByCroppedFace(const SeetaImageData& cropped_face_image,
+    Aggregation aggregation, size_t N, int64_t* identity, float* similarity) const
+{
+    if (!identity || !similarity) return 0;
+    m_impl->JoinRegisteration(ExtractionScheduler::INTERACTIVE);
+    const auto count = this->Count();
+    if (count == 0) return 0;
+    const auto feature_size = m_impl->dim();
+    PooledArray<float> features(feature_size);
+    auto cart_extraction = m_impl->ExtractCroppedFaceParallel(cropped_face_image, features.get());
+    if (cart_extraction == nullptr) return 0;
+    cart_extraction->join();
+    return m_impl->QueryTopIdentities(features.get(), aggregation, N, identity, similarity);
+}
+
+size_t seeta::FaceDatabase::QueryTopIdentitiesByFeatures(const float* features, Aggregation aggregation, size_t N,
+    int64_t* identity, float* similarity) const
+{
+    if (!features || !identity || !similarity) return 0;
+    m_impl->JoinRegisteration(ExtractionScheduler::INTERACTIVE);
+    const auto count = this->Count();
+    if (count == 0) return 0;
+    return m_impl->QueryTopIdentities(features, aggregation, N, identity, similarity);
+}
+
+size_t seeta::FaceDatabase::QueryTopMultiProbe(const float* probes, size_t k, Aggregation aggregation,
+    size_t N, int64_t* index, float* similarity) const
+{
+    if (!probes || k == 0 || !index || !similarity) return 0;
+    m_impl->JoinRegisteration(ExtractionScheduler::INTERACTIVE);
+    const auto count = this->Count();
+    if (count == 0) return 0;
+    return m_impl->QueryTopMultiProbe(probes, k, aggregation, N, index, similarity);
+}
+
+int64_t seeta::FaceDatabase::AddStandingQuery(const float* probe, float threshold)
+{
+    if (!probe) return -1;
+    return m_impl->AddStandingQuery(probe, threshold);
+}
+
+int seeta::FaceDatabase::RemoveStandingQuery(int64_t query)
+{
+    return m_impl->RemoveStandingQuery(query);
+}
+
+void seeta::FaceDatabase::SetStandingCallback(const StandingCallback& callback)
+{
+    m_impl->SetStandingCallback(callback);
+}
+
+void seeta::FaceDatabase::JoinAlerts() const
+{
+    m_impl->JoinAlerts();
+}
+
+bool seeta::FaceDatabase::ComparePairs(float threshold, size_t top_k, const PairCallback& callback,
+    const char* checkpoint) const
+{
+    if (!callback) return false;
+    this->Join();
+    return m_impl->ComparePairs(threshold, top_k, callback, checkpoint);
+}
+
+size_t seeta::FaceDatabase::Cluster(float threshold, size_t k, ClusterMethod method, int64_t* index,
+    int64_t* cluster) const
+{
+    if (!index || !cluster || k == 0) return 0;
+    this->Join();
+    return m_impl->Cluster(threshold, k, method, index, cluster);
+}
+
 void seeta::FaceDatabase::RegisterParallel(const SeetaImageData& image, const SeetaPointF* points, int64_t* index)
 {
     auto cart_registeration = m_impl->RegisterParallel(image, points, index);
@@ -671,11 +2746,36 @@ void seeta::FaceDatabase::RegisterByCroppedFaceParallel(const SeetaImageData& cr
     (void)(cart_registeration);
 }
 
+void seeta::FaceDatabase::RegisterBulkParallel(const SeetaImageData& image, const SeetaPointF* points, int64_t* index,
+    int64_t deadline_ms)
+{
+    auto cart_registeration = m_impl->RegisterParallel(image, points, index, ExtractionScheduler::BULK, Implement::Deadline(deadline_ms));
+    (void)(cart_registeration);
+}
+
+void seeta::FaceDatabase::RegisterBulkByCroppedFaceParallel(const SeetaImageData& cropped_face_image, int64_t* index,
+    int64_t deadline_ms)
+{
+    auto cart_registeration = m_impl->RegisterCroppedFaceParallel(cropped_face_image, index, ExtractionScheduler::BULK, Implement::Deadline(deadline_ms));
+    (void)(cart_registeration);
+}
+
+void seeta::FaceDatabase::RegisterSharedParallel(const seeta::ImageData& image, const SeetaPointF* points, int64_t* index)
+{
+    auto cart_registeration = m_impl->RegisterSharedParallel(image, points, index);
+    (void)(cart_registeration);
+}
+
 void seeta::FaceDatabase::Join() const
 {
     m_impl->JoinRegisteration();
 }
 
+void seeta::FaceDatabase::JoinBulk() const
+{
+    m_impl->JoinRegisteration(ExtractionScheduler::BULK);
+}
+
 bool seeta::FaceDatabase::Save(const char* path) const
 {
     FileWriter ofile(path, FileWriter::Binary);
@@ -706,4 +2806,29 @@ seeta::FaceRecognizer *seeta::FaceDatabase::ExtractionCore(int i)
     return m_impl->ExtractionCore(i);
 }
 
+bool seeta::FaceDatabase::LearnRotation()
+{
+    return m_impl->LearnRotation();
+}
+
+bool seeta::FaceDatabase::Autotune(TuneTarget target, double qps, const char* path)
+{
+    return m_impl->Autotune(target, qps, path);
+}
+
+void seeta::FaceDatabase::set(Property property, double value)
+{
+    m_impl->set(property, value);
+}
+
+double seeta::FaceDatabase::get(Property property) const
+{
+    return m_impl->get(property);
+}
+
+std::string seeta::FaceDatabase::GetMetrics() const
+{
+    return m_impl->Metrics();
+}
+
 
@@ -12,8 +12,14 @@
 #include <fstream>
 #include <cfloat>
 #include <cmath>
+#include <sstream>
 
 #include "FaceAlignment.h"
+#include "Kernels.h"
+#include "ExtractionCache.h"
+#include "FusedPreprocess.h"
+#include "StageTimer.h"
+#include "Tracer.h"
 
 #ifdef SEETA_MODEL_ENCRYPT
 #include "SeetaLANLock.h"
@@ -164,7 +170,22 @@ namespace seeta {
 
             virtual float compare(const float *lhs, const float *rhs, int size) = 0;
 
-            static shared Load(const orz::jug &jug);
+            /**
+             * compare query with n rows, the i-th row starts at rows + i * stride
+             * @note override it to ship an block kernel, default is calling compare row by row
+             */
+            virtual void compare_many(const float *query, const float *rows, size_t stride, size_t n, int size, float *out) {
+                for (size_t i = 0; i < n; ++i) {
+                    out[i] = compare(query, rows + i * stride, size);
+                }
+            }
+
+            /**
+             * @return true if compare is inner product of features, which can be bounded by Cauchy-Schwarz
+             */
+            virtual bool inner_product() const { return false; }
+
+            static shared Load(const orz::jug &jug, int size);
         };
 
         class CompareDot : public CompareEngine {
@@ -173,18 +194,24 @@ namespace seeta {
             using supper = CompareEngine;
             using shared = std::shared_ptr<self>;
 
+            explicit CompareDot(int size)
+                : m_kernel(kernel::FeatureKernel::Select(size)) {}
+
             float compare(const float *lhs, const float *rhs, int size) final {
-                float sum = 0;
-                for (int i = 0; i < size; ++i) {
-                    sum += *lhs * *rhs;
-                    ++lhs;
-                    ++rhs;
-                }
-                return sum;
+                return m_kernel.dot(lhs, rhs, size);
+            }
+
+            void compare_many(const float *query, const float *rows, size_t stride, size_t n, int size, float *out) final {
+                m_kernel.dot_many(query, rows, stride, n, size, out);
             }
+
+            bool inner_product() const final { return true; }
+
+        private:
+            kernel::FeatureKernel m_kernel;
         };
 
-        CompareEngine::shared CompareEngine::Load(const orz::jug &jug) {
+        CompareEngine::shared CompareEngine::Load(const orz::jug &jug, int size) {
             if (jug.invalid(orz::Piece::DICT)) {
                 ORZ_LOG(orz::ERROR) << "Model: /global/compare must be dict" << orz::crash;
             }
@@ -193,7 +220,7 @@ namespace seeta {
                 ORZ_LOG(orz::ERROR) << R"(Model: /global/compare should be set like {"op": "dot"}.)" << orz::crash;
             }
             if (op == "dot") {
-                return std::make_shared<CompareDot>();
+                return std::make_shared<CompareDot>(size);
             } else {
                 ORZ_LOG(orz::ERROR) << "Model: /global/compare \"" << jug << "\" not supported." << orz::crash;
             }
@@ -207,6 +234,20 @@ namespace seeta {
 
             virtual float similarity(float x) = 0;
 
+            /**
+             * map n compared scores to similarity, in and out could be the same buffer
+             */
+            virtual void similarity_many(const float *in, float *out, size_t n) {
+                for (size_t i = 0; i < n; ++i) {
+                    out[i] = similarity(in[i]);
+                }
+            }
+
+            /**
+             * @return lowest x that similarity(x) >= y, -FLT_MAX if every x reaches y or can not be inverted
+             */
+            virtual float inverse(float y) const { return -FLT_MAX; }
+
             static shared Load(const orz::jug &jug);
         };
 
@@ -217,6 +258,16 @@ namespace seeta {
             using shared = std::shared_ptr<self>;
 
             float similarity(float x) final { return std::max<float>(x, 0); }
+
+            void similarity_many(const float *in, float *out, size_t n) final {
+                for (size_t i = 0; i < n; ++i) {
+                    out[i] = std::max<float>(in[i], 0);
+                }
+            }
+
+            float inverse(float y) const final {
+                return y <= 0 ? -FLT_MAX : y;
+            }
         };
 
         class SimilaritySigmoid : public SimilarityEngine {
@@ -232,6 +283,18 @@ namespace seeta {
                 return 1 / (1 + std::exp(m_a - m_b * std::max<float>(x, 0)));
             }
 
+            void similarity_many(const float *in, float *out, size_t n) final {
+                for (size_t i = 0; i < n; ++i) {
+                    out[i] = 1 / (1 + std::exp(m_a - m_b * std::max<float>(in[i], 0)));
+                }
+            }
+
+            float inverse(float y) const final {
+                if (m_b <= 0 || y <= 1 / (1 + std::exp(m_a))) return -FLT_MAX;
+                if (y >= 1) return FLT_MAX;
+                return (m_a - std::log(1 / y - 1)) / m_b;
+            }
+
         private:
             float m_a;
             float m_b;
@@ -368,7 +431,11 @@ namespace seeta {
             }
         }
 
-        static void build_filter(ImageFilter &filter, const std::vector<orz::jug> &pre_processor) {
+        /**
+         * @tparam FILTER ImageFilter, or FusedPreprocess taking the same steps
+         */
+        template <typename FILTER>
+        static void build_filter(FILTER &filter, const std::vector<orz::jug> &pre_processor) {
             filter.clear();
             for (size_t i = 0; i < pre_processor.size(); ++i) {
                 auto &processor = pre_processor[i];
@@ -473,8 +540,23 @@ namespace seeta {
 
             float CalculateSimilarity(const float *features1, const float *features2) const;
 
+            void CalculateSimilarityMany(const float *features, const float *rows, size_t stride, size_t N, float *similarity) const;
+
+            float GetInnerProductThreshold(float similarity) const {
+                if (!m_compare->inner_product()) return -FLT_MAX;
+                return m_similarity->inverse(similarity);
+            }
+
+            bool IsInnerProductCompare() const { return m_compare->inner_product(); }
+
+            void CalculateSimilarityFromInnerProduct(const float *inner_products, size_t N, float *similarity) const {
+                m_similarity->similarity_many(inner_products, similarity, N);
+            }
+
             bool CropFace(const SeetaImageData &image, const SeetaPointF *points, SeetaImageData &face);
 
+            bool CropFace(const FaceRecognizer::YUVImageData &image, const SeetaPointF *points, SeetaImageData &face);
+
 
             int get_cpu_affinity() const {
                 return m_cpu_affinity;
@@ -516,6 +598,12 @@ namespace seeta {
                         break;
                     }
 
+                    case FaceRecognizer::PROPERTY_EXTRACTION_CACHE_SIZE:
+                    {
+                        m_cache->resize(value < 1 ? 0 : size_t(value));
+                        break;
+                    }
+
                 }
             }
 
@@ -527,6 +615,12 @@ namespace seeta {
                         return m_number_threads;
                     case FaceRecognizer::PROPERTY_ARM_CPU_MODE:
                         return get_cpu_affinity();
+                    case FaceRecognizer::PROPERTY_EXTRACTION_CACHE_SIZE:
+                        return double(m_cache->capacity());
+                    case FaceRecognizer::PROPERTY_EXTRACTION_CACHE_HITS:
+                        return double(m_cache->hits());
+                    case FaceRecognizer::PROPERTY_EXTRACTION_CACHE_MISSES:
+                        return double(m_cache->misses());
 
                 }
             }
@@ -538,6 +632,11 @@ namespace seeta {
             SimilarityEngine::shared m_similarity;
             CompareEngine::shared m_compare;
             FaceAlignment::shared m_alignment;
+            kernel::FeatureKernel m_kernel;
+            ExtractionCache::shared m_cache;    ///< shared with clones
+            FusedPreprocess m_fused;    ///< used instead of image filter if compiled
+            mutable std::vector<float> m_fused_input;
+            uint64_t m_fingerprint = 0; ///< seed of cache keys, tells models apart
 
             int32_t m_number_threads = 4;
             int m_cpu_affinity = -1;
@@ -567,41 +666,29 @@ namespace seeta {
             auto device = to_ts_device(setting);
             auto bench = Workbench::Load(tsm, device);
             // ts_Workbench_setup_device(bench.get_raw());
-            ImageFilter filter(device);
-
-            build_filter(filter, param.pre_processor);
-            bench.bind_filter(0, filter);
+            // common chains run fused before input, others by image filter of workbench
+            build_filter(this->m_fused, param.pre_processor);
+            if (!this->m_fused.compile(param.global.input.channels)) {
+                ImageFilter filter(device);
+                build_filter(filter, param.pre_processor);
+                bench.bind_filter(0, filter);
+            }
 
-            this->m_compare = CompareEngine::Load(param.global.compare);
+            this->m_compare = CompareEngine::Load(param.global.compare, param.global.output.size);
+            this->m_kernel = kernel::FeatureKernel::Select(param.global.output.size);
             this->m_similarity = SimilarityEngine::Load(param.global.similarity);
             this->m_alignment = std::make_shared<FaceAlignment>(
                     param.alignment.version,
                     param.alignment.width, param.alignment.height,
                     5);
 
+            this->m_cache = std::make_shared<ExtractionCache>(size_t(param.global.output.size));
+            this->m_fingerprint = hash64(model[0].data(), model[0].size(), uint64_t(param.global.output.size));
+
             this->m_param = param;
             this->m_bench = bench;
         }
 
-        static void normalize(float *features, int num)
-        {
-            double norm = 0;
-            float *dim = features;
-            for (int i = 0; i < num; ++i)
-            {
-                norm += *dim * *dim;
-                ++dim;
-            }
-            norm = std::sqrt(norm) + 1e-5;
-            dim = features;
-            for (int i = 0; i < num; ++i)
-            {
-                *dim /= float(norm);
-                ++dim;
-            }
-        }
-
-
         bool FaceRecognizer::Implement::ExtractCroppedFace(const SeetaImageData &image, float *features) const {
             if (image.height != m_param.global.input.height ||
                 image.width != m_param.global.input.width ||
@@ -610,9 +697,32 @@ namespace seeta {
 
             // ts_Workbench_setup_device(m_bench.get_raw());
 
-            auto tensor = tensor::build(UINT8, {1, image.height, image.width, image.channels}, image.data);
-            m_bench.input(0, tensor);
+            SEETA_STAGE_START(lap);
+            uint64_t key = 0;
+            const auto crop_size = size_t(image.width) * image.height * image.channels;
+            const bool cached = m_cache->enabled();
+            if (cached) {
+                key = hash64(image.data, crop_size, m_fingerprint);
+                const bool hit = m_cache->find(key, image.data, crop_size, features);
+                SEETA_STAGE_LAP(lap, FaceRecognizer::STAGE_CACHE);
+                if (hit) return true;
+            }
+
+            if (m_fused.compiled()) {
+                m_fused_input.resize(size_t(image.height) * image.width * image.channels);
+                m_fused.run(image.data, image.height, image.width, m_fused_input.data());
+                auto tensor = m_fused.chw()
+                              ? tensor::build(FLOAT32, {1, image.channels, image.height, image.width}, m_fused_input.data())
+                              : tensor::build(FLOAT32, {1, image.height, image.width, image.channels}, m_fused_input.data());
+                m_bench.input(0, tensor);
+            } else {
+                // filter bound to input 0 runs in input
+                auto tensor = tensor::build(UINT8, {1, image.height, image.width, image.channels}, image.data);
+                m_bench.input(0, tensor);
+            }
+            SEETA_STAGE_LAP(lap, FaceRecognizer::STAGE_PREPROCESS);
             m_bench.run();
+            SEETA_STAGE_LAP(lap, FaceRecognizer::STAGE_INFERENCE);
             auto output = tensor::cast(FLOAT32, m_bench.output(0));
             auto output_size = m_param.global.output.size;
             if (output.count() != output_size) {
@@ -630,11 +740,15 @@ namespace seeta {
                     }
                 }
             }
+            SEETA_STAGE_LAP(lap, FaceRecognizer::STAGE_OUTPUT);
 
             if (m_param.post_processor.normalize) {
-                normalize(features, output_size);
+                m_kernel.normalize(features, output_size);
+                SEETA_STAGE_LAP(lap, FaceRecognizer::STAGE_NORMALIZE);
             }
 
+            if (cached) m_cache->insert(key, image.data, crop_size, features);
+
             return true;
         }
 
@@ -644,6 +758,17 @@ namespace seeta {
             return m_similarity->similarity(similarity);
         }
 
+        void FaceRecognizer::Implement::CalculateSimilarityMany(const float *features, const float *rows, size_t stride,
+                                                                size_t N, float *similarity) const {
+            if (N == 0) return;
+            if (features == nullptr || rows == nullptr) {
+                std::fill(similarity, similarity + N, 0.0f);
+                return;
+            }
+            m_compare->compare_many(features, rows, stride, N, m_param.global.output.size, similarity);
+            m_similarity->similarity_many(similarity, similarity, N);
+        }
+
         bool FaceRecognizer::Implement::CropFace(const SeetaImageData &image, const SeetaPointF *points,
                                                  SeetaImageData &face) {
             if (m_alignment->crop_width() != face.width || m_alignment->crop_height() != face.height || image.channels != face.channels) {
@@ -654,8 +779,28 @@ namespace seeta {
                                     << face.channels << "]." << orz::crash;
                 return false;
     }
-            m_bench.setup_context();
+            SEETA_STAGE_START(lap);
             m_alignment->crop_face(image, points, face);
+            SEETA_STAGE_LAP(lap, FaceRecognizer::STAGE_CROP);
+            return true;
+        }
+
+        bool FaceRecognizer::Implement::CropFace(const FaceRecognizer::YUVImageData &image, const SeetaPointF *points,
+                                                 SeetaImageData &face) {
+            if (m_alignment->crop_width() != face.width || m_alignment->crop_height() != face.height || face.channels != 3) {
+                ORZ_LOG(orz::ERROR) << "Crop face image data shape must be ["
+                                    << m_alignment->crop_width() << ", " << m_alignment->crop_height() << ", 3], got ["
+                                    << face.width << ", " << face.height << ", "
+                                    << face.channels << "].";
+                return false;
+            }
+            if (image.y == nullptr || image.uv == nullptr || (image.format == FaceRecognizer::YUV_I420 && image.v == nullptr)) {
+                ORZ_LOG(orz::ERROR) << "YUV image misses planes.";
+                return false;
+            }
+            SEETA_STAGE_START(lap);
+            m_alignment->crop_face(image, points, face);
+            SEETA_STAGE_LAP(lap, FaceRecognizer::STAGE_CROP);
             return true;
         }
 
@@ -702,12 +847,42 @@ namespace seeta {
         return m_impl->CalculateSimilarity(features1, features2);
     }
 
+    void FaceRecognizer::CalculateSimilarityMany(const float *features, const float *rows, size_t stride, size_t N,
+                                                 float *similarity) const {
+        if (similarity == nullptr) return;
+        m_impl->CalculateSimilarityMany(features, rows, stride, N, similarity);
+    }
+
+    float FaceRecognizer::GetInnerProductThreshold(float similarity) const {
+        return m_impl->GetInnerProductThreshold(similarity);
+    }
+
+    bool FaceRecognizer::IsInnerProductCompare() const {
+        return m_impl->IsInnerProductCompare();
+    }
+
+    void FaceRecognizer::CalculateSimilarityFromInnerProduct(const float *inner_products, size_t N,
+                                                             float *similarity) const {
+        if (inner_products == nullptr || similarity == nullptr || N == 0) return;
+        m_impl->CalculateSimilarityFromInnerProduct(inner_products, N, similarity);
+    }
+
     bool FaceRecognizer::Extract(const SeetaImageData &image, const SeetaPointF *points, float *features) const {
         seeta::ImageData cropped_face(m_impl->m_alignment->crop_width(), m_impl->m_alignment->crop_height(), m_impl->m_param.alignment.channels);
         if (!m_impl->CropFace(image, points, cropped_face)) return false;
         return m_impl->ExtractCroppedFace(cropped_face, features);
     }
 
+    bool FaceRecognizer::Extract(const YUVImageData &image, const SeetaPointF *points, float *features) const {
+        if (m_impl->m_param.alignment.channels != 3) {
+            ORZ_LOG(orz::ERROR) << "YUV image needs model taking 3 channel faces, got " << m_impl->m_param.alignment.channels << ".";
+            return false;
+        }
+        seeta::ImageData cropped_face(m_impl->m_alignment->crop_width(), m_impl->m_alignment->crop_height(), 3);
+        if (!m_impl->CropFace(image, points, cropped_face)) return false;
+        return m_impl->ExtractCroppedFace(cropped_face, features);
+    }
+
     bool FaceRecognizer::CropFace(const SeetaImageData &image, const SeetaPointF *points, SeetaImageData &face) {
         ORZ_LOG(orz::INFO) << "Using not recommended API CropFace, please use CropFaceV2 instead.";
         if (face.height != 256 || face.width != 256 || face.channels != 3) return false;
@@ -746,6 +921,14 @@ namespace seeta {
         return m_impl->CropFace(image, points, face);
     }
 
+    bool FaceRecognizer::CropFaceV2(const YUVImageData &image, const SeetaPointF *points, SeetaImageData &face) {
+        if (m_impl->m_param.alignment.channels != 3) {
+            ORZ_LOG(orz::ERROR) << "YUV image needs model taking 3 channel faces, got " << m_impl->m_param.alignment.channels << ".";
+            return false;
+        }
+        return m_impl->CropFace(image, points, face);
+    }
+
     FaceRecognizer::FaceRecognizer(const FaceRecognizer::self *other)
             : m_impl(nullptr) {
         if (other == nullptr) {
@@ -763,5 +946,49 @@ namespace seeta {
         return m_impl->get(property);
     }
 
+    bool FaceRecognizer::GetStats(FaceRecognizer::Stage stage, FaceRecognizer::StageStats &stats) {
+        std::memset(&stats, 0, sizeof(stats));
+#ifdef SEETA_STAGE_TIMERS
+        const auto s = int(stage);
+        if (s < 0 || s >= StageTimer::STAGES) return true;
+        const auto snapshot = StageTimer::Global().snapshot();
+        stats.count = snapshot.count[s];
+        stats.total_us = snapshot.total_ns[s] / 1e3;
+        stats.mean_us = stats.count ? stats.total_us / stats.count : 0;
+        static_assert(STAGE_BUCKETS == StageTimer::BUCKETS, "histogram buckets mismatch");
+        uint64_t seen = 0;
+        for (int b = 0; b < STAGE_BUCKETS; ++b) {
+            stats.buckets[b] = snapshot.buckets[s][b];
+            const auto upper_us = double(uint64_t(1) << (b + 1)) / 1e3;
+            if (stats.buckets[b] == 0) continue;
+            if (seen < (stats.count + 1) / 2 && seen + stats.buckets[b] >= (stats.count + 1) / 2) stats.p50_us = upper_us;
+            if (seen < (stats.count * 99 + 99) / 100 && seen + stats.buckets[b] >= (stats.count * 99 + 99) / 100) stats.p99_us = upper_us;
+            seen += stats.buckets[b];
+        }
+        return true;
+#else
+        (void)(stage);
+        return false;
+#endif
+    }
+
+    void FaceRecognizer::ResetStats() {
+        StageTimer::Global().reset();
+    }
+
+    void FaceRecognizer::SetTracing(bool enabled) {
+        Tracer::Global().enable(enabled);
+    }
+
+    std::string FaceRecognizer::DumpTrace() {
+        std::ostringstream out;
+        Tracer::Global().dump(out);
+        return out.str();
+    }
+
+    void FaceRecognizer::ClearTrace() {
+        Tracer::Global().clear();
+    }
+
 
 }
@@ -0,0 +1,270 @@
+#include "seeta/FaceRingGallery.h"
+#include "seeta/FaceRecognizer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Mutex.h"
+
+namespace seeta
+{
+    namespace SEETA_FACE_RECOGNIZE_NAMESPACE_VERSION
+    {
+        class FaceRingGallery::Implement
+        {
+        public:
+            using self = Implement;
+
+            Implement(const SeetaModelSetting &setting, size_t capacity, int64_t ttl)
+                : m_capacity(std::max<size_t>(1, capacity)), m_ttl(ttl)
+            {
+                m_core = std::make_shared<seeta::FaceRecognizer>(setting);
+                m_dim = size_t(m_core->GetExtractFeatureSize());
+                m_features.resize(m_capacity * m_dim);
+                m_timestamps.resize(m_capacity);
+                m_extracted.resize(m_dim);
+            }
+
+            seeta::FaceRecognizer &core() { return *m_core; }
+
+            size_t capacity() const { return m_capacity; }
+
+            size_t dim() const { return m_dim; }
+
+            /**
+             * \brief extract into preallocated buffer, then insert, so registration never allocates
+             */
+            int64_t Register(const SeetaImageData &image, const SeetaPointF *points, int64_t timestamp)
+            {
+                std::unique_lock<std::mutex> _locker(m_extraction_mutex);
+                if (!m_core->Extract(image, points, m_extracted.data())) return -1;
+                return Insert(m_extracted.data(), timestamp);
+            }
+
+            int64_t RegisterByCroppedFace(const SeetaImageData &image, int64_t timestamp)
+            {
+                std::unique_lock<std::mutex> _locker(m_extraction_mutex);
+                if (!m_core->ExtractCroppedFace(image, m_extracted.data())) return -1;
+                return Insert(m_extracted.data(), timestamp);
+            }
+
+            bool Extract(const SeetaImageData &image, const SeetaPointF *points, float *features) const
+            {
+                std::unique_lock<std::mutex> _locker(m_extraction_mutex);
+                return m_core->Extract(image, points, features);
+            }
+
+            bool ExtractCroppedFace(const SeetaImageData &image, float *features) const
+            {
+                std::unique_lock<std::mutex> _locker(m_extraction_mutex);
+                return m_core->ExtractCroppedFace(image, features);
+            }
+
+            const float *Row(int64_t sequence) const { return m_features.data() + size_t(sequence % int64_t(m_capacity)) * m_dim; }
+
+            int64_t Timestamp(int64_t sequence) const { return m_timestamps[size_t(sequence % int64_t(m_capacity))]; }
+
+            /**
+             * \brief first live face with timestamp >= time, timestamps are ordered along the ring, locked by caller
+             */
+            int64_t LowerBound(int64_t time) const
+            {
+                auto first = m_tail, last = m_head;
+                while (first < last)
+                {
+                    auto middle = first + (last - first) / 2;
+                    if (Timestamp(middle) < time) first = middle + 1;
+                    else last = middle;
+                }
+                return first;
+            }
+
+            /**
+             * \brief first live face with timestamp > time, locked by caller
+             */
+            int64_t UpperBound(int64_t time) const
+            {
+                auto first = m_tail, last = m_head;
+                while (first < last)
+                {
+                    auto middle = first + (last - first) / 2;
+                    if (Timestamp(middle) <= time) first = middle + 1;
+                    else last = middle;
+                }
+                return first;
+            }
+
+            int64_t Insert(const float *features, int64_t timestamp)
+            {
+                unique_write_lock<rwmutex> _locker(m_mutex);
+                // full ring overwrites the oldest face
+                if (m_head - m_tail == int64_t(m_capacity)) ++m_tail;
+                if (m_head > m_tail) timestamp = std::max(timestamp, m_latest);
+                const auto slot = size_t(m_head % int64_t(m_capacity));
+                std::memcpy(&m_features[slot * m_dim], features, m_dim * sizeof(float));
+                m_timestamps[slot] = timestamp;
+                m_latest = timestamp;
+                return m_head++;
+            }
+
+            size_t Expire(int64_t now)
+            {
+                unique_write_lock<rwmutex> _locker(m_mutex);
+                const auto first = LowerBound(now - m_ttl);
+                const auto dropped = size_t(first - m_tail);
+                m_tail = first;
+                return dropped;
+            }
+
+            void Clear()
+            {
+                unique_write_lock<rwmutex> _locker(m_mutex);
+                m_tail = m_head;
+            }
+
+            size_t Count() const
+            {
+                unique_read_lock<rwmutex> _locker(m_mutex);
+                return size_t(m_head - m_tail);
+            }
+
+            int64_t GetTimestamp(int64_t index) const
+            {
+                unique_read_lock<rwmutex> _locker(m_mutex);
+                if (index < m_tail || index >= m_head) return -1;
+                return Timestamp(index);
+            }
+
+            size_t QueryTop(const float *features, int64_t since, int64_t until, size_t N, int64_t *index, float *similarity) const
+            {
+                unique_read_lock<rwmutex> _locker(m_mutex);
+                const auto first = LowerBound(since);
+                const auto last = UpperBound(until);
+                if (first >= last) return 0;
+
+                // window is at most two runs of slots, split where ring wraps
+                const auto count = size_t(last - first);
+                const auto slot = size_t(first % int64_t(m_capacity));
+                const auto run = std::min(count, m_capacity - slot);
+                std::vector<float> scores(count);
+                m_core->CalculateSimilarityMany(features, Row(first), m_dim, run, scores.data());
+                if (run < count) m_core->CalculateSimilarityMany(features, m_features.data(), m_dim, count - run, scores.data() + run);
+
+                std::vector<std::pair<int64_t, float>> result(count);
+                for (size_t i = 0; i < count; ++i) result[i] = std::make_pair(first + int64_t(i), scores[i]);
+                const size_t top_n = std::min(N, result.size());
+                std::partial_sort(result.begin(), result.begin() + top_n, result.end(), [](
+                    const std::pair<int64_t, float> &a, const std::pair<int64_t, float> &b) -> bool
+                {
+                    return a.second > b.second;
+                });
+                for (size_t i = 0; i < top_n; ++i)
+                {
+                    index[i] = result[i].first;
+                    similarity[i] = result[i].second;
+                }
+                return top_n;
+            }
+
+        private:
+            std::shared_ptr<seeta::FaceRecognizer> m_core;
+            mutable std::mutex m_extraction_mutex;
+            std::vector<float> m_extracted; ///< features of face being registered
+
+            size_t m_capacity;
+            int64_t m_ttl;
+            size_t m_dim = 0;
+            std::vector<float> m_features;  ///< capacity rows, face of sequence s lives in slot s % capacity
+            std::vector<int64_t> m_timestamps;
+            int64_t m_head = 0; ///< sequence of next face
+            int64_t m_tail = 0; ///< sequence of oldest live face
+            int64_t m_latest = 0;   ///< timestamp of newest face
+
+            mutable rwmutex m_mutex;
+        };
+    }
+}
+
+seeta::FaceRingGallery::FaceRingGallery(const SeetaModelSetting& setting, size_t capacity, int64_t ttl)
+    : m_impl(new Implement(setting, capacity, ttl))
+{
+}
+
+seeta::FaceRingGallery::~FaceRingGallery()
+{
+    delete m_impl;
+}
+
+int64_t seeta::FaceRingGallery::Register(const SeetaImageData& image, const SeetaPointF* points, int64_t timestamp)
+{
+    if (!points) return -1;
+    return m_impl->Register(image, points, timestamp);
+}
+
+int64_t seeta::FaceRingGallery::RegisterByCroppedFace(const SeetaImageData& cropped_face_image, int64_t timestamp)
+{
+    return m_impl->RegisterByCroppedFace(cropped_face_image, timestamp);
+}
+
+int64_t seeta::FaceRingGallery::RegisterFeatures(const float* features, int64_t timestamp)
+{
+    if (!features) return -1;
+    return m_impl->Insert(features, timestamp);
+}
+
+size_t seeta::FaceRingGallery::Expire(int64_t now)
+{
+    return m_impl->Expire(now);
+}
+
+void seeta::FaceRingGallery::Clear()
+{
+    m_impl->Clear();
+}
+
+size_t seeta::FaceRingGallery::Count() const
+{
+    return m_impl->Count();
+}
+
+size_t seeta::FaceRingGallery::Capacity() const
+{
+    return m_impl->capacity();
+}
+
+int64_t seeta::FaceRingGallery::GetTimestamp(int64_t index) const
+{
+    return m_impl->GetTimestamp(index);
+}
+
+size_t seeta::FaceRingGallery::QueryTop(const SeetaImageData& image, const SeetaPointF* points, int64_t since,
+    int64_t until, size_t N, int64_t* index, float* similarity) const
+{
+    if (!points || !index || !similarity) return 0;
+    std::unique_ptr<float[]> features(new float[m_impl->dim()]);
+    if (!m_impl->Extract(image, points, features.get())) return 0;
+    return m_impl->QueryTop(features.get(), since, until, N, index, similarity);
+}
+
+size_t seeta::FaceRingGallery::QueryTopByCroppedFace(const SeetaImageData& cropped_face_image, int64_t since,
+    int64_t until, size_t N, int64_t* index, float* similarity) const
+{
+    if (!index || !similarity) return 0;
+    std::unique_ptr<float[]> features(new float[m_impl->dim()]);
+    if (!m_impl->ExtractCroppedFace(cropped_face_image, features.get())) return 0;
+    return m_impl->QueryTop(features.get(), since, until, N, index, similarity);
+}
+
+size_t seeta::FaceRingGallery::QueryTopByFeatures(const float* features, int64_t since, int64_t until, size_t N,
+    int64_t* index, float* similarity) const
+{
+    if (!features || !index || !similarity) return 0;
+    return m_impl->QueryTop(features, since, until, N, index, similarity);
+}
+
+seeta::FaceRecognizer* seeta::FaceRingGallery::ExtractionCore()
+{
+    return &m_impl->core();
+}
@@ -0,0 +1,161 @@
+#ifndef SEETA_FACERECOGNIZER_FUSEDPREPROCESS_H
+#define SEETA_FACERECOGNIZER_FUSEDPREPROCESS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace seeta {
+    /**
+     * Pre processor chain compiled into one pass from uint8 HWC image to float input.
+     * Steps are taken like ImageFilter. After to_float, scale, sub_mean, div_std and channel_swap act on each value
+     * alone, so the chain becomes one 256-entry table per output channel, built by running the steps in order on every
+     * byte value; output is bit exact with the step by step chain. to_chw may only be last.
+     * Chains with other steps, or arithmetic before to_float, are not fusable and stay with ImageFilter.
+     */
+    class FusedPreprocess {
+    public:
+        using self = FusedPreprocess;
+
+        void clear() { *this = self(); }
+
+        void to_float() {
+            if (m_chw) m_fusable = false;
+            m_float = true;
+        }
+
+        void to_chw() {
+            if (m_chw) m_fusable = false;
+            m_chw = true;
+        }
+
+        void scale(float scale) { step(SCALE, std::vector<float>(1, scale)); }
+
+        void sub_mean(const std::vector<float> &mean) { step(SUB_MEAN, mean); }
+
+        void div_std(const std::vector<float> &std_value) { step(DIV_STD, std_value); }
+
+        void channel_swap(const std::vector<int> &shuffle) { step(CHANNEL_SWAP, std::vector<float>(shuffle.begin(), shuffle.end())); }
+
+        void center_crop(int) { m_fusable = false; }
+
+        void center_crop(int, int) { m_fusable = false; }
+
+        void resize(int) { m_fusable = false; }
+
+        void resize(int, int) { m_fusable = false; }
+
+        void prewhiten() { m_fusable = false; }
+
+        /**
+         * build tables for images of channels
+         * @return false if steps can not be fused, run is not usable then
+         */
+        bool compile(int channels) {
+            m_tables.clear();
+            m_source.clear();
+            if (!m_fusable || !m_float || channels <= 0) return false;
+            const auto C = size_t(channels);
+            for (auto &step : m_steps) {
+                const auto size = step.values.size();
+                if (step.op == CHANNEL_SWAP) {
+                    if (size != C) return false;
+                    for (auto value : step.values) if (value < 0 || value >= channels) return false;
+                } else if (step.op != SCALE && size != 1 && size != C) {
+                    return false;
+                }
+            }
+            // output channel c takes input channel m_source[c]
+            m_source.resize(C);
+            for (size_t c = 0; c < C; ++c) m_source[c] = int(c);
+            m_tables.resize(C * 256);
+            std::vector<float> values(C), swapped(C);
+            std::vector<int> source(C);
+            for (int byte = 0; byte < 256; ++byte) {
+                for (auto &value : values) value = float(byte);
+                for (auto &step : m_steps) {
+                    switch (step.op) {
+                        case SCALE:
+                            for (auto &value : values) value = value * step.values[0];
+                            break;
+                        case SUB_MEAN:
+                            for (size_t c = 0; c < C; ++c) values[c] = values[c] - step.values[step.values.size() == 1 ? 0 : c];
+                            break;
+                        case DIV_STD:
+                            for (size_t c = 0; c < C; ++c) values[c] = values[c] / step.values[step.values.size() == 1 ? 0 : c];
+                            break;
+                        case CHANNEL_SWAP:
+                            for (size_t c = 0; c < C; ++c) swapped[c] = values[size_t(step.values[c])];
+                            values.swap(swapped);
+                            if (byte == 0) {
+                                for (size_t c = 0; c < C; ++c) source[c] = m_source[size_t(step.values[c])];
+                                m_source.swap(source);
+                            }
+                            break;
+                    }
+                }
+                for (size_t c = 0; c < C; ++c) m_tables[c * 256 + byte] = values[c];
+            }
+            return true;
+        }
+
+        bool compiled() const { return !m_tables.empty(); }
+
+        int channels() const { return int(m_source.size()); }
+
+        /**
+         * true if output is CHW, else HWC
+         */
+        bool chw() const { return m_chw; }
+
+        /**
+         * @param image HWC image of channels() channels
+         * @param output height * width * channels() floats
+         */
+        void run(const uint8_t *image, int height, int width, float *output) const {
+            const auto C = m_source.size();
+            const auto pixels = size_t(height) * size_t(width);
+            if (m_chw) {
+                for (size_t c = 0; c < C; ++c) {
+                    const float *table = &m_tables[c * 256];
+                    const uint8_t *plane = image + m_source[c];
+                    float *out = output + c * pixels;
+                    for (size_t p = 0; p < pixels; ++p) out[p] = table[plane[p * C]];
+                }
+                return;
+            }
+            for (size_t p = 0; p < pixels; ++p) {
+                const uint8_t *pixel = image + p * C;
+                float *out = output + p * C;
+                for (size_t c = 0; c < C; ++c) out[c] = m_tables[c * 256 + pixel[m_source[c]]];
+            }
+        }
+
+    private:
+        enum Op {
+            SCALE,
+            SUB_MEAN,
+            DIV_STD,
+            CHANNEL_SWAP,
+        };
+
+        struct Step {
+            Op op;
+            std::vector<float> values;
+        };
+
+        void step(Op op, const std::vector<float> &values) {
+            if (!m_float || m_chw || values.empty()) m_fusable = false;
+            m_steps.push_back(Step{op, values});
+        }
+
+        std::vector<Step> m_steps;
+        bool m_float = false;
+        bool m_chw = false;
+        bool m_fusable = true;
+        std::vector<int> m_source;  ///< input channel of each output channel
+        std::vector<float> m_tables;    ///< 256 values of each output channel
+    };
+}
+
+#endif //SEETA_FACERECOGNIZER_FUSEDPREPROCESS_H
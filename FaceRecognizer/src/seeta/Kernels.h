@@ -0,0 +1,176 @@
+#ifndef SEETA_FACERECOGNIZER_KERNELS_H
+#define SEETA_FACERECOGNIZER_KERNELS_H
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+namespace seeta {
+    namespace kernel {
+        /**
+         * Feature kernels with fixed trip count, N must be multiple of 8.
+         * 8 independent accumulators let compiler vectorize without reassociation.
+         */
+        template <int N>
+        inline float dot(const float *lhs, const float *rhs) {
+            float sum[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+            for (int i = 0; i < N; i += 8) {
+                for (int j = 0; j < 8; ++j) {
+                    sum[j] += lhs[i + j] * rhs[i + j];
+                }
+            }
+            return ((sum[0] + sum[1]) + (sum[2] + sum[3])) + ((sum[4] + sum[5]) + (sum[6] + sum[7]));
+        }
+
+        inline float dot(const float *lhs, const float *rhs, int size) {
+            float sum = 0;
+            for (int i = 0; i < size; ++i) {
+                sum += *lhs * *rhs;
+                ++lhs;
+                ++rhs;
+            }
+            return sum;
+        }
+
+        template <int N>
+        inline void dot_many(const float *query, const float *rows, size_t stride, size_t n, float *out) {
+            for (size_t i = 0; i < n; ++i) {
+                out[i] = dot<N>(query, rows + i * stride);
+            }
+        }
+
+        inline void dot_many(const float *query, const float *rows, size_t stride, size_t n, int size, float *out) {
+            // 4 rows share each load of query
+            size_t i = 0;
+            for (; n - i >= 4; i += 4) {
+                const float *row0 = rows + i * stride;
+                const float *row1 = row0 + stride;
+                const float *row2 = row1 + stride;
+                const float *row3 = row2 + stride;
+                float sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+                for (int j = 0; j < size; ++j) {
+                    auto q = query[j];
+                    sum0 += q * row0[j];
+                    sum1 += q * row1[j];
+                    sum2 += q * row2[j];
+                    sum3 += q * row3[j];
+                }
+                out[i] = sum0;
+                out[i + 1] = sum1;
+                out[i + 2] = sum2;
+                out[i + 3] = sum3;
+            }
+            for (; i < n; ++i) {
+                out[i] = dot(query, rows + i * stride, size);
+            }
+        }
+
+        template <int N>
+        inline void normalize(float *features) {
+            double norm = dot<N>(features, features);
+            norm = std::sqrt(norm) + 1e-5;
+            const auto scale = float(1 / norm);
+            for (int i = 0; i < N; ++i) {
+                features[i] *= scale;
+            }
+        }
+
+        inline void normalize(float *features, int size) {
+            double norm = 0;
+            float *dim = features;
+            for (int i = 0; i < size; ++i) {
+                norm += *dim * *dim;
+                ++dim;
+            }
+            norm = std::sqrt(norm) + 1e-5;
+            dim = features;
+            for (int i = 0; i < size; ++i) {
+                *dim /= float(norm);
+                ++dim;
+            }
+        }
+
+        inline int popcount(uint64_t x) {
+#if defined(_MSC_VER) && defined(_M_X64)
+            return int(__popcnt64(x));
+#elif defined(__GNUC__) || defined(__clang__)
+            return __builtin_popcountll(x);
+#else
+            x = x - ((x >> 1) & 0x5555555555555555ULL);
+            x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+            x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+            return int((x * 0x0101010101010101ULL) >> 56);
+#endif
+        }
+
+        /**
+         * 1 bit per dimension, set if the dimension is positive, tail bits are zero
+         * @param words must be (size + 63) / 64
+         */
+        inline void sign_signature(const float *features, int size, uint64_t *signature, int words) {
+            for (int w = 0; w < words; ++w) {
+                uint64_t bits = 0;
+                const int begin = w * 64;
+                const int end = begin + 64 < size ? begin + 64 : size;
+                for (int i = begin; i < end; ++i) {
+                    if (features[i] > 0) bits |= uint64_t(1) << (i - begin);
+                }
+                signature[w] = bits;
+            }
+        }
+
+        inline int hamming(const uint64_t *lhs, const uint64_t *rhs, int words) {
+            int distance = 0;
+            for (int w = 0; w < words; ++w) {
+                distance += popcount(lhs[w] ^ rhs[w]);
+            }
+            return distance;
+        }
+
+        /**
+         * Kernel table selected once by feature size, fallback to generic loops if size is not specialized.
+         */
+        class FeatureKernel {
+        public:
+            using self = FeatureKernel;
+
+            using DotFunction = float (*)(const float *lhs, const float *rhs, int size);
+            using DotManyFunction = void (*)(const float *query, const float *rows, size_t stride, size_t n, int size, float *out);
+            using NormalizeFunction = void (*)(float *features, int size);
+
+            DotFunction dot = &kernel::dot;
+            DotManyFunction dot_many = &kernel::dot_many;
+            NormalizeFunction normalize = &kernel::normalize;
+            int size = 0;   ///< specialized size, 0 for generic
+
+            static self Select(int size) {
+                switch (size) {
+                    case 128: return Fixed<128>();
+                    case 256: return Fixed<256>();
+                    case 512: return Fixed<512>();
+                    case 1024: return Fixed<1024>();
+                    default: return self();
+                }
+            }
+
+        private:
+            template <int N>
+            static self Fixed() {
+                self fixed;
+                fixed.dot = [](const float *lhs, const float *rhs, int) { return kernel::dot<N>(lhs, rhs); };
+                fixed.dot_many = [](const float *query, const float *rows, size_t stride, size_t n, int, float *out) {
+                    kernel::dot_many<N>(query, rows, stride, n, out);
+                };
+                fixed.normalize = [](float *features, int) { kernel::normalize<N>(features); };
+                fixed.size = N;
+                return fixed;
+            }
+        };
+    }
+}
+
+#endif //SEETA_FACERECOGNIZER_KERNELS_H
@@ -0,0 +1,211 @@
+#include "PCA.h"
+
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+
+namespace seeta {
+    void accumulate_moment(const float *rows, size_t stride, size_t n, int dim, std::vector<double> &moment) {
+        moment.resize(size_t(dim) * dim, 0);
+        for (size_t k = 0; k < n; ++k) {
+            const float *x = rows + k * stride;
+            for (int i = 0; i < dim; ++i) {
+                const double xi = x[i];
+                double *line = &moment[size_t(i) * dim];
+                for (int j = i; j < dim; ++j) {
+                    line[j] += xi * x[j];
+                }
+            }
+        }
+    }
+
+    /**
+     * Householder reduction of symmetric v to tridiagonal form, v is replaced by the orthogonal transformation V
+     * d gets diagonal, e gets sub-diagonal in e[1..n-1]
+     * @note v is stored transposed (column major V) so the inner loops walk contiguous memory
+     */
+    static void tridiagonalize(std::vector<double> &v, size_t n, std::vector<double> &d, std::vector<double> &e) {
+        auto V = [&](size_t i, size_t j) -> double & { return v[j * n + i]; };
+        for (size_t j = 0; j < n; ++j) d[j] = V(n - 1, j);
+        for (size_t i = n - 1; i > 0; --i) {
+            double scale = 0;
+            double h = 0;
+            for (size_t k = 0; k < i; ++k) scale += std::fabs(d[k]);
+            if (scale == 0) {
+                e[i] = d[i - 1];
+                for (size_t j = 0; j < i; ++j) {
+                    d[j] = V(i - 1, j);
+                    V(i, j) = 0;
+                    V(j, i) = 0;
+                }
+            } else {
+                for (size_t k = 0; k < i; ++k) {
+                    d[k] /= scale;
+                    h += d[k] * d[k];
+                }
+                double f = d[i - 1];
+                double g = std::sqrt(h);
+                if (f > 0) g = -g;
+                e[i] = scale * g;
+                h -= f * g;
+                d[i - 1] = f - g;
+                for (size_t j = 0; j < i; ++j) e[j] = 0;
+                for (size_t j = 0; j < i; ++j) {
+                    f = d[j];
+                    V(j, i) = f;
+                    g = e[j] + V(j, j) * f;
+                    for (size_t k = j + 1; k + 1 <= i; ++k) {
+                        g += V(k, j) * d[k];
+                        e[k] += V(k, j) * f;
+                    }
+                    e[j] = g;
+                }
+                f = 0;
+                for (size_t j = 0; j < i; ++j) {
+                    e[j] /= h;
+                    f += e[j] * d[j];
+                }
+                const double hh = f / (h + h);
+                for (size_t j = 0; j < i; ++j) e[j] -= hh * d[j];
+                for (size_t j = 0; j < i; ++j) {
+                    f = d[j];
+                    g = e[j];
+                    for (size_t k = j; k + 1 <= i; ++k) V(k, j) -= (f * e[k] + g * d[k]);
+                    d[j] = V(i - 1, j);
+                    V(i, j) = 0;
+                }
+            }
+            d[i] = h;
+        }
+        // accumulate transformations
+        for (size_t i = 0; i + 1 < n; ++i) {
+            V(n - 1, i) = V(i, i);
+            V(i, i) = 1;
+            const double h = d[i + 1];
+            if (h != 0) {
+                for (size_t k = 0; k <= i; ++k) d[k] = V(k, i + 1) / h;
+                for (size_t j = 0; j <= i; ++j) {
+                    double g = 0;
+                    for (size_t k = 0; k <= i; ++k) g += V(k, i + 1) * V(k, j);
+                    for (size_t k = 0; k <= i; ++k) V(k, j) -= g * d[k];
+                }
+            }
+            for (size_t k = 0; k <= i; ++k) V(k, i + 1) = 0;
+        }
+        for (size_t j = 0; j < n; ++j) {
+            d[j] = V(n - 1, j);
+            V(n - 1, j) = 0;
+        }
+        V(n - 1, n - 1) = 1;
+        e[0] = 0;
+    }
+
+    /**
+     * implicit QL iterations on tridiagonal (d, e), w holds transformation transposed (row i is column i)
+     * after call, d gets eigenvalues and row i of w gets the eigenvector of d[i]
+     */
+    static void diagonalize(std::vector<double> &w, size_t n, std::vector<double> &d, std::vector<double> &e) {
+        for (size_t i = 1; i < n; ++i) e[i - 1] = e[i];
+        e[n - 1] = 0;
+        double f = 0;
+        double tst1 = 0;
+        const double eps = std::pow(2.0, -52.0);
+        for (size_t l = 0; l < n; ++l) {
+            tst1 = std::max(tst1, std::fabs(d[l]) + std::fabs(e[l]));
+            size_t m = l;
+            while (m < n) {
+                if (std::fabs(e[m]) <= eps * tst1) break;
+                ++m;
+            }
+            if (m > l) {
+                int iter = 0;
+                do {
+                    if (++iter > 64) break;
+                    double g = d[l];
+                    double p = (d[l + 1] - g) / (2 * e[l]);
+                    double r = std::hypot(p, 1.0);
+                    if (p < 0) r = -r;
+                    d[l] = e[l] / (p + r);
+                    d[l + 1] = e[l] * (p + r);
+                    const double dl1 = d[l + 1];
+                    double h = g - d[l];
+                    for (size_t i = l + 2; i < n; ++i) d[i] -= h;
+                    f += h;
+
+                    p = d[m];
+                    double c = 1, c2 = 1, c3 = 1;
+                    const double el1 = e[l + 1];
+                    double s = 0, s2 = 0;
+                    for (size_t i = m; i-- > l;) {
+                        c3 = c2;
+                        c2 = c;
+                        s2 = s;
+                        g = c * e[i];
+                        h = c * p;
+                        r = std::hypot(p, e[i]);
+                        e[i + 1] = s * r;
+                        s = e[i] / r;
+                        c = p / r;
+                        p = c * d[i] - s * g;
+                        d[i + 1] = h + s * (c * g + s * d[i]);
+                        double *wi = &w[i * n];
+                        double *wi1 = &w[(i + 1) * n];
+                        for (size_t k = 0; k < n; ++k) {
+                            h = wi1[k];
+                            wi1[k] = s * wi[k] + c * h;
+                            wi[k] = c * wi[k] - s * h;
+                        }
+                    }
+                    p = -s * s2 * c3 * el1 * e[l] / dl1;
+                    e[l] = s * p;
+                    d[l] = c * p;
+                } while (std::fabs(e[l]) > eps * tst1);
+            }
+            d[l] += f;
+            e[l] = 0;
+        }
+    }
+
+    std::vector<double> principal_axes(std::vector<double> &moment, int dim, std::vector<float> &rotation) {
+        const size_t n = size_t(dim);
+        auto &v = moment;
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = 0; j < i; ++j) {
+                v[i * n + j] = v[j * n + i];
+            }
+        }
+
+        std::vector<double> d(n), e(n);
+        tridiagonalize(v, n, d, e);
+        auto &w = v;    // already transposed
+        diagonalize(w, n, d, e);
+
+        std::vector<size_t> order(n);
+        std::iota(order.begin(), order.end(), size_t(0));
+        std::sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+            return d[lhs] > d[rhs];
+        });
+
+        std::vector<double> eigenvalues(n);
+        rotation.resize(n * n);
+        for (size_t i = 0; i < n; ++i) {
+            const auto axis = order[i];
+            eigenvalues[i] = d[axis];
+            for (size_t j = 0; j < n; ++j) {
+                rotation[i * n + j] = float(w[axis * n + j]);
+            }
+        }
+        return eigenvalues;
+    }
+
+    void rotate(const float *rotation, int dim, const float *x, float *y) {
+        for (int i = 0; i < dim; ++i) {
+            const float *line = rotation + size_t(i) * dim;
+            float sum = 0;
+            for (int j = 0; j < dim; ++j) {
+                sum += line[j] * x[j];
+            }
+            y[i] = sum;
+        }
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef SEETA_FACERECOGNIZER_PCA_H
+#define SEETA_FACERECOGNIZER_PCA_H
+
+#include <vector>
+#include <cstddef>
+
+namespace seeta {
+    /**
+     * accumulate second moment sum(x * x^T) of rows, only upper triangle is filled
+     * @param rows row major, row i starts at rows + i * stride
+     * @param n number of rows
+     * @param dim feature size
+     * @param moment dim x dim, row major
+     */
+    void accumulate_moment(const float *rows, size_t stride, size_t n, int dim, std::vector<double> &moment);
+
+    /**
+     * compute principal axes of symmetric matrix by Householder tridiagonalization and implicit QL
+     * @param moment dim x dim symmetric matrix, row major, only upper triangle is read, destroyed after call
+     * @param dim matrix size
+     * @param rotation dim x dim, row i is the i-th axis, sorted by eigenvalue descending
+     * @return eigenvalues sorted descending
+     * @note rotation is orthogonal, so rotation * x keeps inner products and norms
+     */
+    std::vector<double> principal_axes(std::vector<double> &moment, int dim, std::vector<float> &rotation);
+
+    /**
+     * y = rotation * x, y and x can not be the same buffer
+     */
+    void rotate(const float *rotation, int dim, const float *x, float *y);
+}
+
+#endif //SEETA_FACERECOGNIZER_PCA_H
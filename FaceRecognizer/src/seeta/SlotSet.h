@@ -0,0 +1,144 @@
+#ifndef SEETA_FACERECOGNIZER_SLOTSET_H
+#define SEETA_FACERECOGNIZER_SLOTSET_H
+
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+
+#include "Kernels.h"
+
+namespace seeta {
+    /**
+     * Compressed bitmap of slots, only non-empty chunks of CHUNK slots are stored, sorted by chunk key.
+     * Intersection walks chunks of the smallest set, so it costs about the selected size, not the gallery size.
+     */
+    class SlotSet {
+    public:
+        using self = SlotSet;
+
+        static const size_t CHUNK = 4096;
+        static const size_t WORDS = CHUNK / 64;
+
+        void insert(size_t slot) {
+            auto &chunk = find_or_create(slot / CHUNK);
+            auto &word = chunk.words[(slot % CHUNK) / 64];
+            const auto bit = uint64_t(1) << (slot % 64);
+            if (word & bit) return;
+            word |= bit;
+            ++chunk.count;
+            ++m_size;
+        }
+
+        void erase(size_t slot) {
+            auto it = lower_bound(slot / CHUNK);
+            if (it == m_chunks.end() || it->key != slot / CHUNK) return;
+            auto &word = it->words[(slot % CHUNK) / 64];
+            const auto bit = uint64_t(1) << (slot % 64);
+            if (!(word & bit)) return;
+            word &= ~bit;
+            --m_size;
+            if (--it->count == 0) m_chunks.erase(it);
+        }
+
+        bool contains(size_t slot) const {
+            auto it = lower_bound(slot / CHUNK);
+            if (it == m_chunks.end() || it->key != slot / CHUNK) return false;
+            return (it->words[(slot % CHUNK) / 64] >> (slot % 64)) & 1;
+        }
+
+        size_t size() const { return m_size; }
+
+        bool empty() const { return m_size == 0; }
+
+        /**
+         * heap bytes held by chunks
+         */
+        size_t bytes() const {
+            return m_chunks.capacity() * sizeof(Chunk) + m_chunks.size() * WORDS * sizeof(uint64_t);
+        }
+
+        /**
+         * append slots of this set, in ascending order
+         */
+        void slots(std::vector<size_t> &out) const {
+            for (auto &chunk : m_chunks) {
+                emit(chunk.key, chunk.words.data(), out);
+            }
+        }
+
+        /**
+         * append slots contained by all sets, in ascending order
+         */
+        static void intersect(std::vector<const self *> sets, std::vector<size_t> &out) {
+            if (sets.empty()) return;
+            std::sort(sets.begin(), sets.end(), [](const self *lhs, const self *rhs) {
+                return lhs->m_chunks.size() < rhs->m_chunks.size();
+            });
+            std::vector<uint64_t> words(WORDS);
+            for (auto &chunk : sets[0]->m_chunks) {
+                std::copy(chunk.words.begin(), chunk.words.end(), words.begin());
+                bool hit = true;
+                for (size_t i = 1; i < sets.size() && hit; ++i) {
+                    auto it = sets[i]->lower_bound(chunk.key);
+                    if (it == sets[i]->m_chunks.end() || it->key != chunk.key) {
+                        hit = false;
+                        break;
+                    }
+                    uint64_t any = 0;
+                    for (size_t w = 0; w < WORDS; ++w) {
+                        words[w] &= it->words[w];
+                        any |= words[w];
+                    }
+                    hit = any != 0;
+                }
+                if (hit) emit(chunk.key, words.data(), out);
+            }
+        }
+
+    private:
+        struct Chunk {
+            size_t key = 0;
+            size_t count = 0;
+            std::vector<uint64_t> words;
+        };
+
+        std::vector<Chunk>::iterator lower_bound(size_t key) {
+            return std::lower_bound(m_chunks.begin(), m_chunks.end(), key, [](const Chunk &chunk, size_t key) {
+                return chunk.key < key;
+            });
+        }
+
+        std::vector<Chunk>::const_iterator lower_bound(size_t key) const {
+            return std::lower_bound(m_chunks.begin(), m_chunks.end(), key, [](const Chunk &chunk, size_t key) {
+                return chunk.key < key;
+            });
+        }
+
+        Chunk &find_or_create(size_t key) {
+            auto it = lower_bound(key);
+            if (it != m_chunks.end() && it->key == key) return *it;
+            Chunk chunk;
+            chunk.key = key;
+            chunk.words.resize(WORDS, 0);
+            return *m_chunks.insert(it, std::move(chunk));
+        }
+
+        static void emit(size_t key, const uint64_t *words, std::vector<size_t> &out) {
+            const auto base = key * CHUNK;
+            for (size_t w = 0; w < WORDS; ++w) {
+                auto bits = words[w];
+                while (bits) {
+                    const auto low = bits & (~bits + 1);
+                    out.push_back(base + w * 64 + size_t(kernel::popcount(low - 1)));
+                    bits ^= low;
+                }
+            }
+        }
+
+        std::vector<Chunk> m_chunks;
+        size_t m_size = 0;
+    };
+}
+
+#endif //SEETA_FACERECOGNIZER_SLOTSET_H
@@ -0,0 +1,171 @@
+#ifndef SEETA_FACERECOGNIZER_STAGETIMER_H
+#define SEETA_FACERECOGNIZER_STAGETIMER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Tracer.h"
+
+namespace seeta {
+    /**
+     * Latency histograms of extraction stages, summed over all threads of the process.
+     * Each thread owns one block and is its only writer, so recording takes no lock and no read-modify-write;
+     * readers sum the blocks. Reset keeps a baseline instead of clearing, so it never races writers.
+     * Record through SEETA_STAGE_START / SEETA_STAGE_LAP, which are compiled out without SEETA_STAGE_TIMERS.
+     * Laps are traced too while Tracer is enabled.
+     */
+    class StageTimer {
+    public:
+        using self = StageTimer;
+        using Clock = std::chrono::steady_clock;
+
+        static const int STAGES = 6;
+        static const int BUCKETS = 32;  ///< bucket i counts durations in [2^i, 2^(i+1)) ns, the last one is open
+
+        struct Snapshot {
+            uint64_t count[STAGES] = {};
+            uint64_t total_ns[STAGES] = {};
+            uint64_t buckets[STAGES][BUCKETS] = {};
+        };
+
+        /**
+         * @return name of stage in traces
+         */
+        static const char *Name(int stage) {
+            static const char *names[STAGES] = {"crop", "cache", "preprocess", "inference", "output", "normalize"};
+            return names[stage];
+        }
+
+        /**
+         * never destroyed, like BufferPool, blocks of exited threads are kept
+         */
+        static self &Global() {
+            static self *timer = new self;
+            return *timer;
+        }
+
+        /**
+         * record duration of stage for calling thread
+         */
+        void record(int stage, Clock::duration duration) {
+            auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+            if (ns < 0) ns = 0;
+            auto &block = local();
+            Bump(block.count[stage], 1);
+            Bump(block.total_ns[stage], uint64_t(ns));
+            Bump(block.buckets[stage][Bucket(uint64_t(ns))], 1);
+        }
+
+        /**
+         * @return stages recorded since last reset, fields are read one by one, so records in flight may show in some of them only
+         */
+        Snapshot snapshot() const {
+            std::unique_lock<std::mutex> _locker(m_mutex);
+            auto sum = Sum();
+            for (int s = 0; s < STAGES; ++s) {
+                sum.count[s] -= m_baseline.count[s];
+                sum.total_ns[s] -= m_baseline.total_ns[s];
+                for (int b = 0; b < BUCKETS; ++b) sum.buckets[s][b] -= m_baseline.buckets[s][b];
+            }
+            return sum;
+        }
+
+        void reset() {
+            std::unique_lock<std::mutex> _locker(m_mutex);
+            m_baseline = Sum();
+        }
+
+        /**
+         * Times consecutive stages, each lap records time since the previous one
+         */
+        class Lap {
+        public:
+            Lap() : m_last(Clock::now()) {}
+
+            void operator()(int stage) {
+                const auto now = Clock::now();
+                Global().record(stage, now - m_last);
+                Tracer::Global().record("extraction", Name(stage), m_last, now);
+                m_last = now;
+            }
+
+        private:
+            Clock::time_point m_last;
+        };
+
+    private:
+        struct Block {
+            Block() {
+                for (int s = 0; s < STAGES; ++s) {
+                    count[s] = 0;
+                    total_ns[s] = 0;
+                    for (int b = 0; b < BUCKETS; ++b) buckets[s][b] = 0;
+                }
+            }
+
+            std::atomic<uint64_t> count[STAGES];
+            std::atomic<uint64_t> total_ns[STAGES];
+            std::atomic<uint64_t> buckets[STAGES][BUCKETS];
+        };
+
+        StageTimer() = default;
+
+        static void Bump(std::atomic<uint64_t> &value, uint64_t delta) {
+            // single writer, plain store keeps readers tear free
+            value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+        }
+
+        static int Bucket(uint64_t ns) {
+            int bucket = 0;
+            while (ns > 1 && bucket < BUCKETS - 1) {
+                ns >>= 1;
+                ++bucket;
+            }
+            return bucket;
+        }
+
+        Block &local() {
+            thread_local Block *block = nullptr;
+            if (block == nullptr) {
+                std::unique_ptr<Block> created(new Block);
+                block = created.get();
+                std::unique_lock<std::mutex> _locker(m_mutex);
+                m_blocks.push_back(std::move(created));
+            }
+            return *block;
+        }
+
+        /**
+         * locked by caller
+         */
+        Snapshot Sum() const {
+            Snapshot sum;
+            for (auto &block : m_blocks) {
+                for (int s = 0; s < STAGES; ++s) {
+                    sum.count[s] += block->count[s].load(std::memory_order_relaxed);
+                    sum.total_ns[s] += block->total_ns[s].load(std::memory_order_relaxed);
+                    for (int b = 0; b < BUCKETS; ++b) sum.buckets[s][b] += block->buckets[s][b].load(std::memory_order_relaxed);
+                }
+            }
+            return sum;
+        }
+
+        mutable std::mutex m_mutex;
+        std::vector<std::unique_ptr<Block>> m_blocks;
+        Snapshot m_baseline;
+    };
+}
+
+#ifdef SEETA_STAGE_TIMERS
+#define SEETA_STAGE_START(lap) seeta::StageTimer::Lap lap
+#define SEETA_STAGE_LAP(lap, stage) lap(stage)
+#else
+#define SEETA_STAGE_START(lap)
+#define SEETA_STAGE_LAP(lap, stage) ((void)0)
+#endif
+
+#endif //SEETA_FACERECOGNIZER_STAGETIMER_H
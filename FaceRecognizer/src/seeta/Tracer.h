@@ -0,0 +1,200 @@
+#ifndef SEETA_FACERECOGNIZER_TRACER_H
+#define SEETA_FACERECOGNIZER_TRACER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace seeta {
+    /**
+     * Begin and end of request phases, kept in per-thread rings of the last CAPACITY events and dumped as Chrome trace JSON.
+     * Each thread owns one ring and is its only writer; readers copy rings and drop events overwritten meanwhile.
+     * Ring of an exited thread is dumped until a new thread takes it over, so rings never outnumber threads alive at once.
+     * Disabled tracing costs one relaxed load per phase. Names and categories must be string literals.
+     */
+    class Tracer {
+    public:
+        using self = Tracer;
+        using Clock = std::chrono::steady_clock;
+
+        static const uint64_t CAPACITY = 1 << 14;   ///< events of each thread, power of 2
+
+        /**
+         * never destroyed, like StageTimer, so threads exiting late can still hand back their rings
+         */
+        static self &Global() {
+            static self *tracer = new self;
+            return *tracer;
+        }
+
+        void enable(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+
+        bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+        /**
+         * record phase of calling thread, ignored if disabled
+         */
+        void record(const char *category, const char *name, Clock::time_point begin, Clock::time_point end) {
+            if (!enabled()) return;
+            auto &ring = local();
+            const auto i = ring.head.load(std::memory_order_relaxed);
+            auto &event = ring.events[i & (CAPACITY - 1)];
+            // claim before overwriting, readers drop what was claimed while they copied
+            ring.claimed.store(i + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            event.category.store(category, std::memory_order_relaxed);
+            event.name.store(name, std::memory_order_relaxed);
+            event.begin_ns.store(Nanoseconds(begin), std::memory_order_relaxed);
+            event.end_ns.store(Nanoseconds(end), std::memory_order_relaxed);
+            ring.head.store(i + 1, std::memory_order_release);
+        }
+
+        /**
+         * drop recorded events, writers keep going
+         */
+        void clear() {
+            std::unique_lock<std::mutex> _locker(m_mutex);
+            for (auto &ring : m_rings) ring->cleared = ring->head.load(std::memory_order_acquire);
+        }
+
+        /**
+         * write events since last clear in Chrome trace event format, loadable by chrome://tracing and Perfetto UI
+         */
+        void dump(std::ostream &out) const {
+            std::unique_lock<std::mutex> _locker(m_mutex);
+            out << "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [";
+            bool first = true;
+            std::vector<Copy> copies;
+            for (auto &ring : m_rings) {
+                const auto head = ring->head.load(std::memory_order_acquire);
+                auto begin = std::max(ring->cleared, head > CAPACITY ? head - CAPACITY : 0);
+                copies.clear();
+                for (auto i = begin; i < head; ++i) {
+                    auto &event = ring->events[i & (CAPACITY - 1)];
+                    copies.push_back(Copy{event.category.load(std::memory_order_relaxed), event.name.load(std::memory_order_relaxed),
+                                          event.begin_ns.load(std::memory_order_relaxed), event.end_ns.load(std::memory_order_relaxed)});
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                const auto claimed = ring->claimed.load(std::memory_order_relaxed);
+                const auto valid = claimed > CAPACITY ? claimed - CAPACITY : 0;
+                for (size_t j = 0; j < copies.size(); ++j) {
+                    if (begin + j < valid) continue;
+                    auto &copy = copies[j];
+                    out << (first ? "\n" : ",\n")
+                        << "{\"name\": \"" << copy.name << "\", \"cat\": \"" << copy.category << "\", \"ph\": \"X\""
+                        << ", \"ts\": " << copy.begin_ns / 1000 << "." << Fraction(copy.begin_ns)
+                        << ", \"dur\": " << (copy.end_ns - copy.begin_ns) / 1000 << "." << Fraction(copy.end_ns - copy.begin_ns)
+                        << ", \"pid\": 1, \"tid\": " << ring->tid << "}";
+                    first = false;
+                }
+            }
+            out << "\n]}\n";
+        }
+
+        /**
+         * Records one phase from construction to destruction, if tracing was enabled at construction
+         */
+        class Scope {
+        public:
+            Scope(const char *category, const char *name) : m_category(category), m_name(name) {
+                if (Global().enabled()) m_begin = Clock::now();
+            }
+
+            ~Scope() {
+                if (m_begin != Clock::time_point()) Global().record(m_category, m_name, m_begin, Clock::now());
+            }
+
+            Scope(const Scope &) = delete;
+            Scope &operator=(const Scope &) = delete;
+
+        private:
+            const char *m_category;
+            const char *m_name;
+            Clock::time_point m_begin;
+        };
+
+    private:
+        struct Event {
+            std::atomic<const char *> category{""};
+            std::atomic<const char *> name{""};
+            std::atomic<int64_t> begin_ns{0};
+            std::atomic<int64_t> end_ns{0};
+        };
+
+        struct Copy {
+            const char *category;
+            const char *name;
+            int64_t begin_ns;
+            int64_t end_ns;
+        };
+
+        struct Ring {
+            explicit Ring(size_t tid) : tid(tid), events(new Event[CAPACITY]) {}
+
+            size_t tid;     ///< guarded by m_mutex
+            std::unique_ptr<Event[]> events;
+            std::atomic<uint64_t> head{0};      ///< events published
+            std::atomic<uint64_t> claimed{0};   ///< events being written or published
+            uint64_t cleared = 0;   ///< first event dumped, guarded by m_mutex
+        };
+
+        Tracer() = default;
+
+        static int64_t Nanoseconds(Clock::time_point time) {
+            return int64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count());
+        }
+
+        static char Fraction(int64_t ns) {
+            return char('0' + (ns % 1000) / 100);
+        }
+
+        /**
+         * hands ring of calling thread back to m_free when the thread exits
+         */
+        struct Owner {
+            Ring *ring = nullptr;
+
+            ~Owner() {
+                if (ring == nullptr) return;
+                auto &tracer = Global();
+                std::unique_lock<std::mutex> _locker(tracer.m_mutex);
+                tracer.m_free.push_back(ring);
+            }
+        };
+
+        Ring &local() {
+            thread_local Owner owner;
+            if (owner.ring == nullptr) {
+                std::unique_lock<std::mutex> _locker(m_mutex);
+                if (m_free.empty()) {
+                    m_rings.emplace_back(new Ring(++m_threads));
+                    owner.ring = m_rings.back().get();
+                } else {
+                    // events of exited thread are dropped, so they are not dumped under new tid
+                    owner.ring = m_free.back();
+                    m_free.pop_back();
+                    owner.ring->tid = ++m_threads;
+                    owner.ring->cleared = owner.ring->head.load(std::memory_order_relaxed);
+                }
+            }
+            return *owner.ring;
+        }
+
+        std::atomic<bool> m_enabled{false};
+        mutable std::mutex m_mutex;
+        std::vector<std::unique_ptr<Ring>> m_rings;
+        std::vector<Ring *> m_free;     ///< rings of exited threads, still dumped until taken over
+        size_t m_threads = 0;   ///< threads given a ring, for tid
+    };
+}
+
+#define SEETA_TRACE_CONCAT_(a, b) a##b
+#define SEETA_TRACE_CONCAT(a, b) SEETA_TRACE_CONCAT_(a, b)
+#define SEETA_TRACE_SCOPE(category, name) seeta::Tracer::Scope SEETA_TRACE_CONCAT(_trace_scope_, __LINE__)(category, name)
+
+#endif //SEETA_FACERECOGNIZER_TRACER_H
@@ -0,0 +1,101 @@
+#ifndef SEETA_FACERECOGNIZER_YUVWARP_H
+#define SEETA_FACERECOGNIZER_YUVWARP_H
+
+#include <algorithm>
+#include <cstdint>
+
+#include "seeta/FaceRecognizer.h"
+
+namespace seeta {
+    namespace yuv {
+        /**
+         * bilinear sample of plane at (x, y), neighbours past the last row or column repeat it
+         * @param step bytes between horizontal neighbours, 2 for interleaved chroma
+         */
+        inline float bilinear(const uint8_t *plane, int stride, int step, int width, int height, float x, float y) {
+            x = std::min(std::max(x, 0.0f), float(width - 1));
+            y = std::min(std::max(y, 0.0f), float(height - 1));
+            const int x0 = int(x), y0 = int(y);
+            const int x1 = std::min(x0 + 1, width - 1), y1 = std::min(y0 + 1, height - 1);
+            const float fx = x - x0, fy = y - y0;
+            const uint8_t *row0 = plane + size_t(y0) * stride;
+            const uint8_t *row1 = plane + size_t(y1) * stride;
+            const float top = row0[x0 * step] + (row0[x1 * step] - row0[x0 * step]) * fx;
+            const float bottom = row1[x0 * step] + (row1[x1 * step] - row1[x0 * step]) * fx;
+            return top + (bottom - top) * fy;
+        }
+
+        inline uint8_t saturate(float value) {
+            return uint8_t(value <= 0 ? 0 : value >= 255 ? 255 : value + 0.5f);
+        }
+    }
+
+    /**
+     * Affine warp of packed image into packed crop of same channels, each channel sampled bilinearly.
+     * Needs no compute context, so one alignment crops on any number of threads. Positions outside image are zero.
+     * @param M 3x3 row-major affine mapping crop pixel to image position
+     * @param face width * height * image.channels bytes
+     */
+    inline void packed_affine_sample(const SeetaImageData &image, const float *M, uint8_t *face, int width, int height) {
+        const int channels = image.channels;
+        const int stride = image.width * channels;
+        const float right = float(image.width - 1), bottom = float(image.height - 1);
+
+        for (int y = 0; y < height; ++y) {
+            uint8_t *out = face + size_t(y) * width * channels;
+            for (int x = 0; x < width; ++x, out += channels) {
+                const float sx = M[0] * x + M[1] * y + M[2];
+                const float sy = M[3] * x + M[4] * y + M[5];
+                if (sx < 0 || sy < 0 || sx > right || sy > bottom) {
+                    std::fill(out, out + channels, uint8_t(0));
+                    continue;
+                }
+                for (int c = 0; c < channels; ++c) {
+                    out[c] = yuv::saturate(yuv::bilinear(image.data + c, stride, channels, image.width, image.height, sx, sy));
+                }
+            }
+        }
+    }
+
+    /**
+     * Affine warp of 4:2:0 frame into packed BGR crop; planes are sampled bilinearly at each output pixel and
+     * converted there by BT.601 limited range, so the frame is never converted as a whole.
+     * Chroma samples sit at centers of their 2x2 luma blocks. Positions outside frame are black, like zero padding of packed crops.
+     * @param M 3x3 row-major affine mapping crop pixel to frame position
+     * @param bgr width * height * 3 bytes
+     */
+    inline void yuv_affine_sample(const FaceRecognizer::YUVImageData &image, const float *M, uint8_t *bgr, int width, int height) {
+        const int chroma_width = (image.width + 1) / 2;
+        const int chroma_height = (image.height + 1) / 2;
+        const bool planar = image.format == FaceRecognizer::YUV_I420;
+        const uint8_t *u_plane = image.uv;
+        const uint8_t *v_plane = planar ? image.v : image.uv + 1;
+        if (image.format == FaceRecognizer::YUV_NV21) std::swap(u_plane, v_plane);
+        const int u_stride = image.uv_stride;
+        const int v_stride = planar ? image.v_stride : image.uv_stride;
+        const int step = planar ? 1 : 2;
+        const float right = float(image.width - 1), bottom = float(image.height - 1);
+
+        for (int y = 0; y < height; ++y) {
+            uint8_t *out = bgr + size_t(y) * width * 3;
+            for (int x = 0; x < width; ++x, out += 3) {
+                const float sx = M[0] * x + M[1] * y + M[2];
+                const float sy = M[3] * x + M[4] * y + M[5];
+                if (sx < 0 || sy < 0 || sx > right || sy > bottom) {
+                    out[0] = out[1] = out[2] = 0;
+                    continue;
+                }
+                const float cx = (sx + 0.5f) / 2 - 0.5f;
+                const float cy = (sy + 0.5f) / 2 - 0.5f;
+                const float luma = 1.164f * (yuv::bilinear(image.y, image.y_stride, 1, image.width, image.height, sx, sy) - 16);
+                const float u = yuv::bilinear(u_plane, u_stride, step, chroma_width, chroma_height, cx, cy) - 128;
+                const float v = yuv::bilinear(v_plane, v_stride, step, chroma_width, chroma_height, cx, cy) - 128;
+                out[0] = yuv::saturate(luma + 2.018f * u);
+                out[1] = yuv::saturate(luma - 0.813f * v - 0.391f * u);
+                out[2] = yuv::saturate(luma + 1.596f * v);
+            }
+        }
+    }
+}
+
+#endif //SEETA_FACERECOGNIZER_YUVWARP_H
@@ -0,0 +1,110 @@
+#ifndef SEETA_BENCH_BENCHUTILS_H
+#define SEETA_BENCH_BENCHUTILS_H
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace seeta {
+    namespace bench {
+        using Clock = std::chrono::steady_clock;
+        using Params = std::vector<std::pair<std::string, double>>;
+
+        struct Result {
+            std::string name;
+            Params params;
+            size_t iterations = 0;
+            double mean_us = 0;
+            double p50_us = 0;
+            double p99_us = 0;
+            double items_per_second = 0;
+            Params metrics; ///< extra outcomes of the run, like recall
+        };
+
+        inline std::vector<size_t> ParseList(const std::string &list) {
+            std::vector<size_t> values;
+            std::stringstream items(list);
+            std::string item;
+            while (std::getline(items, item, ',')) {
+                if (!item.empty()) values.push_back(size_t(std::stoull(item)));
+            }
+            return values;
+        }
+
+        /**
+         * time each call of func, items are processed by one call
+         */
+        template <typename FUNC>
+        Result Measure(const std::string &name, const Params &params, size_t iterations, size_t items, FUNC func) {
+            func();   // warm up
+            std::vector<double> spent(std::max<size_t>(1, iterations));
+            for (auto &us : spent) {
+                auto start = Clock::now();
+                func();
+                us = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+            }
+            Result result;
+            result.name = name;
+            result.params = params;
+            result.iterations = spent.size();
+            double total = 0;
+            for (auto us : spent) total += us;
+            result.mean_us = total / spent.size();
+            std::sort(spent.begin(), spent.end());
+            result.p50_us = spent[(spent.size() - 1) / 2];
+            result.p99_us = spent[(spent.size() * 99 + 99) / 100 - 1];
+            result.items_per_second = result.mean_us > 0 ? items * 1e6 / result.mean_us : 0;
+            std::cerr << name << ": " << result.mean_us << " us" << std::endl;
+            return result;
+        }
+
+        inline std::string Escape(const std::string &text) {
+            std::string escaped;
+            for (auto c : text) {
+                if (c == '"' || c == '\\') escaped.push_back('\\');
+                escaped.push_back(c);
+            }
+            return escaped;
+        }
+
+        inline void WriteParams(std::ostream &out, const Params &params) {
+            for (size_t j = 0; j < params.size(); ++j) {
+                out << (j ? ", " : "") << "\"" << Escape(params[j].first) << "\": " << params[j].second;
+            }
+        }
+
+        /**
+         * \param info string fields written after benchmark name
+         */
+        inline void WriteJson(std::ostream &out, const std::string &benchmark,
+                              const std::vector<std::pair<std::string, std::string>> &info, const std::vector<Result> &results) {
+            out << "{\n  \"benchmark\": \"" << Escape(benchmark) << "\",\n";
+            for (auto &field : info) out << "  \"" << Escape(field.first) << "\": \"" << Escape(field.second) << "\",\n";
+            out << "  \"hardware_concurrency\": " << std::thread::hardware_concurrency() << ",\n";
+            out << "  \"results\": [";
+            for (size_t i = 0; i < results.size(); ++i) {
+                auto &result = results[i];
+                out << (i ? ",\n" : "\n") << "    {\"name\": \"" << Escape(result.name) << "\", \"params\": {";
+                WriteParams(out, result.params);
+                out << "}, \"iterations\": " << result.iterations
+                    << ", \"mean_us\": " << result.mean_us
+                    << ", \"p50_us\": " << result.p50_us
+                    << ", \"p99_us\": " << result.p99_us
+                    << ", \"items_per_second\": " << result.items_per_second;
+                if (!result.metrics.empty()) {
+                    out << ", ";
+                    WriteParams(out, result.metrics);
+                }
+                out << "}";
+            }
+            out << "\n  ]\n}\n";
+        }
+    }
+}
+
+#endif //SEETA_BENCH_BENCHUTILS_H
@@ -0,0 +1,155 @@
+#ifndef SEETA_BENCH_SYNTHETICGALLERY_H
+#define SEETA_BENCH_SYNTHETICGALLERY_H
+
+#include "seeta/Stream.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <vector>
+
+namespace seeta {
+    namespace bench {
+        struct SyntheticSpec {
+            size_t dim = 512;
+            size_t identities = 10000;  ///< enrolled identities
+            size_t faces_per_identity = 10; ///< enrolled faces of each identity
+            float noise = 0.5f; ///< norm of noise added to identity direction, cosine of two faces of one identity is about 1 / (1 + noise^2)
+            uint32_t seed = 1;
+        };
+
+        /**
+         * Clustered unit-norm embeddings. Each identity is a random direction, each face is its direction
+         * plus isotropic gaussian noise, normalized. Distinct identities are nearly orthogonal.
+         * Faces are pure functions of (seed, identity, sample), so nothing is stored.
+         * Gallery row r is sample r % faces_per_identity of identity r / faces_per_identity,
+         * genuine probes are unseen samples of enrolled identities, impostors are identities never enrolled.
+         * \note not thread safe, the direction of the last identity is cached
+         */
+        class SyntheticFaces {
+        public:
+            explicit SyntheticFaces(const SyntheticSpec &spec)
+                : m_spec(spec), m_center(spec.dim) {}
+
+            const SyntheticSpec &spec() const { return m_spec; }
+
+            uint64_t gallery_size() const { return uint64_t(m_spec.identities) * m_spec.faces_per_identity; }
+
+            int64_t identity_of(uint64_t row) const { return int64_t(row / std::max<size_t>(1, m_spec.faces_per_identity)); }
+
+            void gallery(uint64_t row, float *features) {
+                const auto per_identity = std::max<size_t>(1, m_spec.faces_per_identity);
+                face(row / per_identity, row % per_identity, features);
+            }
+
+            /**
+             * \param view 0 or 1, two unseen faces of the identity of probe
+             * \return enrolled identity of probe
+             */
+            int64_t genuine(uint64_t probe, float *features, int view = 0) {
+                const auto identity = Mix(m_spec.seed, probe, 1) % std::max<size_t>(1, m_spec.identities);
+                face(identity, m_spec.faces_per_identity + 2 * probe + (view ? 1 : 0), features);
+                return int64_t(identity);
+            }
+
+            /**
+             * \param view any face of the identity of probe
+             */
+            void impostor(uint64_t probe, float *features, int view = 0) {
+                face(m_spec.identities + probe, uint64_t(view), features);
+            }
+
+        private:
+            static uint64_t Mix(uint64_t a, uint64_t b, uint64_t c) {
+                // splitmix64 over the three keys
+                uint64_t x = a * 0x9E3779B97F4A7C15ULL ^ (b + 0xBF58476D1CE4E5B9ULL) * 0x94D049BB133111EBULL ^ c;
+                x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+                x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+                return x ^ (x >> 31);
+            }
+
+            static void Normalize(float *features, size_t dim) {
+                double norm = 0;
+                for (size_t i = 0; i < dim; ++i) norm += double(features[i]) * features[i];
+                const auto scale = float(1 / std::sqrt(std::max(norm, 1e-12)));
+                for (size_t i = 0; i < dim; ++i) features[i] *= scale;
+            }
+
+            void face(uint64_t identity, uint64_t sample, float *features) {
+                const auto dim = m_spec.dim;
+                if (identity != m_center_identity) {
+                    std::mt19937_64 generator(Mix(m_spec.seed, identity, 0));
+                    std::normal_distribution<float> normal;
+                    for (auto &value : m_center) value = normal(generator);
+                    Normalize(m_center.data(), dim);
+                    m_center_identity = identity;
+                }
+                std::copy(m_center.begin(), m_center.end(), features);
+                if (m_spec.noise <= 0) return;
+                std::mt19937_64 generator(Mix(m_spec.seed, identity, sample + 2));
+                std::normal_distribution<float> normal(0, float(m_spec.noise / std::sqrt(double(dim))));
+                for (size_t i = 0; i < dim; ++i) features[i] += normal(generator);
+                Normalize(features, dim);
+            }
+
+            SyntheticSpec m_spec;
+            std::vector<float> m_center;
+            uint64_t m_center_identity = UINT64_MAX;
+        };
+
+        /**
+         * database stream of rows produced while read, so galleries of any size never exist twice in memory;
+         * row i is saved with index i
+         */
+        class GalleryStream : public seeta::StreamReader {
+        public:
+            using Row = std::function<void(uint64_t, float *)>;
+
+            GalleryStream(uint64_t count, uint64_t dim, Row row)
+                : m_count(count), m_dim(dim), m_row(std::move(row)), m_record(sizeof(int64_t) + dim * sizeof(float)) {
+                const int flag = 0x7726;
+                m_pending.resize(sizeof(flag) + 2 * sizeof(uint64_t));
+                std::memcpy(&m_pending[0], &flag, sizeof(flag));
+                std::memcpy(&m_pending[sizeof(flag)], &m_count, sizeof(m_count));
+                std::memcpy(&m_pending[sizeof(flag) + sizeof(m_count)], &m_dim, sizeof(m_dim));
+            }
+
+            size_t read(char *data, size_t length) override {
+                size_t done = 0;
+                while (done < length) {
+                    if (m_offset == m_pending.size()) {
+                        if (m_next == int64_t(m_count)) break;
+                        Generate();
+                    }
+                    const auto step = std::min(length - done, m_pending.size() - m_offset);
+                    std::memcpy(data + done, &m_pending[m_offset], step);
+                    m_offset += step;
+                    done += step;
+                }
+                return done;
+            }
+
+        private:
+            void Generate() {
+                m_pending = m_record;
+                const auto index = m_next++;
+                std::memcpy(&m_pending[0], &index, sizeof(index));
+                m_row(uint64_t(index), reinterpret_cast<float *>(&m_pending[sizeof(index)]));
+                m_offset = 0;
+            }
+
+            uint64_t m_count;
+            uint64_t m_dim;
+            Row m_row;
+            std::vector<char> m_record;
+            std::vector<char> m_pending;
+            size_t m_offset = 0;
+            int64_t m_next = 0;
+        };
+    }
+}
+
+#endif //SEETA_BENCH_SYNTHETICGALLERY_H
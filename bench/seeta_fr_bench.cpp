@@ -0,0 +1,285 @@
+//
+// Microbenchmarks of recognizer and database, results are written as JSON
+//
+
+#include "seeta/FaceRecognizer.h"
+#include "seeta/FaceDatabase.h"
+#include "seeta/Stream.h"
+#include "seeta/common_alignment.h"
+#include "FaceAlignment.h"
+#include "BenchUtils.h"
+#include "SyntheticGallery.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    using seeta::bench::Clock;
+    using seeta::bench::Measure;
+    using seeta::bench::ParseList;
+    using seeta::bench::Result;
+
+    struct Options {
+        std::string model;
+        std::string output;
+        std::string workdir = ".";
+        std::vector<size_t> sizes = { 10000, 100000, 1000000 };
+        std::vector<int> cores;
+        size_t iterations = 100;
+        size_t batch = 32;
+    };
+
+    seeta::ImageData RandomImage(int width, int height, int channels, std::mt19937 &generator) {
+        seeta::ImageData image(width, height, channels);
+        for (int i = 0; i < image.count(); ++i) image.data[i] = static_cast<unsigned char>(generator());
+        return image;
+    }
+
+    /**
+     * stamp counter into first pixels, so repeated crops never hit extraction cache
+     */
+    void Stamp(seeta::ImageData &image, uint64_t counter) {
+        std::memcpy(image.data, &counter, std::min<size_t>(sizeof(counter), size_t(image.count())));
+    }
+
+    const SeetaPointF POINTS[5] = {
+        { 134.929, 126.889 },
+        { 190.865, 120.054 },
+        { 167.091, 158.991 },
+        { 143.787, 186.269 },
+        { 193.805, 181.186 },
+    };
+
+    void BenchCrop(const Options &options, std::vector<Result> &results) {
+        std::mt19937 generator(1);
+        auto image = RandomImage(320, 320, 3, generator);
+        float points[10];
+        for (int i = 0; i < 5; ++i) {
+            points[2 * i] = POINTS[i].x;
+            points[2 * i + 1] = POINTS[i].y;
+        }
+        const float mean_shape[10] = {
+            89.3095f, 72.9025f, 169.3095f, 72.9025f, 127.8949f, 127.0441f, 96.8796f, 184.8907f, 159.1065f, 184.7601f,
+        };
+        seeta::ImageData face(256, 256, 3);
+        results.push_back(Measure("face_crop_core", { { "width", 256 }, { "height", 256 } }, options.iterations, 1, [&]() {
+            face_crop_core(image.data, image.width, image.height, image.channels, face.data, 256, 256, points, 5, mean_shape, 256, 256);
+        }));
+
+        const struct {
+            const char *mode;
+            int size;
+        } modes[] = { { "single", 256 }, { "multi", 112 }, { "arcface", 112 } };
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); ++m) {
+            seeta::FaceAlignment alignment(modes[m].mode, modes[m].size, modes[m].size, 5);
+            seeta::ImageData crop(alignment.crop_width(), alignment.crop_height(), 3);
+            results.push_back(Measure(std::string("crop_face_") + modes[m].mode, { { "width", crop.width }, { "height", crop.height } },
+                                      options.iterations, 1, [&]() {
+                alignment.crop_face(image, POINTS, crop);
+            }));
+        }
+    }
+
+    /**
+     * stage timers of library since last reset, as results
+     */
+    void StageResults(std::vector<Result> &results) {
+        const char *names[] = { "crop", "cache", "preprocess", "inference", "output", "normalize" };
+        for (int stage = 0; stage < int(sizeof(names) / sizeof(names[0])); ++stage) {
+            seeta::FaceRecognizer::StageStats stats;
+            if (!seeta::FaceRecognizer::GetStats(seeta::FaceRecognizer::Stage(stage), stats)) return;
+            if (stats.count == 0) continue;
+            Result result;
+            result.name = std::string("stage_") + names[stage];
+            result.iterations = size_t(stats.count);
+            result.mean_us = stats.mean_us;
+            result.p50_us = stats.p50_us;
+            result.p99_us = stats.p99_us;
+            result.items_per_second = stats.mean_us > 0 ? 1e6 / stats.mean_us : 0;
+            results.push_back(result);
+        }
+    }
+
+    void BenchRecognizer(const Options &options, const seeta::ModelSetting &setting, std::vector<Result> &results) {
+        seeta::FaceRecognizer recognizer(setting);
+        std::mt19937 generator(2);
+        auto image = RandomImage(320, 320, 3, generator);
+        auto face = recognizer.CropFaceV2(image, POINTS);
+        const auto dim = size_t(recognizer.GetExtractFeatureSize());
+        std::vector<float> features(dim * options.batch);
+
+        uint64_t counter = 0;
+        seeta::FaceRecognizer::ResetStats();
+        results.push_back(Measure("extract_cropped_face", { { "batch", 1 } }, options.iterations, 1, [&]() {
+            Stamp(face, ++counter);
+            recognizer.ExtractCroppedFace(face, features.data());
+        }));
+        // no batched forward in engine, batch N is N calls back to back
+        results.push_back(Measure("extract_cropped_face", { { "batch", double(options.batch) } },
+                                  std::max<size_t>(1, options.iterations / options.batch), options.batch, [&]() {
+            for (size_t i = 0; i < options.batch; ++i) {
+                Stamp(face, ++counter);
+                recognizer.ExtractCroppedFace(face, &features[i * dim]);
+            }
+        }));
+
+        StageResults(results);
+
+        results.push_back(Measure("calculate_similarity", { { "dim", double(dim) } }, options.iterations, 1000, [&]() {
+            volatile float sink = 0;
+            for (int i = 0; i < 1000; ++i) sink = sink + recognizer.CalculateSimilarity(&features[0], &features[dim]);
+        }));
+        const size_t rows = options.batch;
+        std::vector<float> scores(rows);
+        results.push_back(Measure("calculate_similarity_many", { { "dim", double(dim) }, { "rows", double(rows) } },
+                                  options.iterations, rows, [&]() {
+            recognizer.CalculateSimilarityMany(features.data(), features.data(), dim, rows, scores.data());
+        }));
+    }
+
+    void BenchDatabase(const Options &options, const seeta::ModelSetting &setting, std::vector<Result> &results) {
+        const auto threads = int(std::max(1u, std::thread::hardware_concurrency()));
+        std::mt19937 generator(3);
+        auto image = RandomImage(320, 320, 3, generator);
+        for (auto size : options.sizes) {
+            seeta::FaceDatabase db(setting, 1, threads);
+            const auto dim = size_t(db.ExtractionCore()->GetExtractFeatureSize());
+            auto face = db.ExtractionCore()->CropFaceV2(image, POINTS);
+            std::vector<float> probe(dim);
+            db.ExtractionCore()->ExtractCroppedFace(face, probe.data());
+
+            // one face per identity without noise, rows are random directions
+            seeta::bench::SyntheticSpec spec;
+            spec.dim = dim;
+            spec.identities = size;
+            spec.faces_per_identity = 1;
+            spec.noise = 0;
+            spec.seed = uint32_t(size);
+            seeta::bench::SyntheticFaces faces(spec);
+            seeta::bench::GalleryStream gallery(size, dim, [&](uint64_t row, float *features) { faces.gallery(row, features); });
+            auto start = Clock::now();
+            db.Load(gallery);
+            std::cerr << "gallery of " << size << " faces: "
+                      << std::chrono::duration<double>(Clock::now() - start).count() << " s" << std::endl;
+
+            const double mb = double(size) * (dim * sizeof(float) + sizeof(int64_t)) / (1 << 20);
+            const auto iterations = std::max<size_t>(3, options.iterations * 10000 / std::max<size_t>(size, 10000));
+            int64_t index[10];
+            float similarity[10];
+            for (int prefilter = 0; prefilter < 2; ++prefilter) {
+                db.set(seeta::FaceDatabase::PROPERTY_PREFILTER_CANDIDATES, prefilter ? 1000 : 0);
+                const std::vector<std::pair<std::string, double>> params = {
+                    { "gallery", double(size) }, { "dim", double(dim) }, { "threads", double(threads) }, { "prefilter", prefilter ? 1000.0 : 0.0 },
+                };
+                results.push_back(Measure("query_top_features", params, iterations, 1, [&]() {
+                    db.QueryTopMultiProbe(probe.data(), 1, seeta::FaceDatabase::AGGREGATION_MAX, 10, index, similarity);
+                }));
+                results.push_back(Measure("query_top", params, iterations, 1, [&]() {
+                    db.QueryTopByCroppedFace(face, 10, index, similarity);
+                }));
+            }
+            db.set(seeta::FaceDatabase::PROPERTY_PREFILTER_CANDIDATES, 0);
+            results.push_back(Measure("query_above", { { "gallery", double(size) }, { "dim", double(dim) }, { "threads", double(threads) } },
+                                      iterations, 1, [&]() {
+                db.QueryAboveByCroppedFace(face, 0.6f, 10, index, similarity);
+            }));
+
+            const auto path = options.workdir + "/seeta_fr_bench.db";
+            results.push_back(Measure("save", { { "gallery", double(size) }, { "megabytes", mb } }, 3, 1, [&]() {
+                db.Save(path.c_str());
+            }));
+            results.push_back(Measure("load", { { "gallery", double(size) }, { "megabytes", mb } }, 3, 1, [&]() {
+                db.Load(path.c_str());
+            }));
+            std::remove(path.c_str());
+        }
+    }
+
+    void BenchRegister(const Options &options, const seeta::ModelSetting &setting, std::vector<Result> &results) {
+        std::vector<int> cores = options.cores;
+        if (cores.empty()) {
+            const auto threads = int(std::max(1u, std::thread::hardware_concurrency()));
+            for (int n = 1; n < threads; n *= 2) cores.push_back(n);
+            cores.push_back(threads);
+        }
+        std::mt19937 generator(4);
+        auto image = RandomImage(320, 320, 3, generator);
+        uint64_t counter = 0;
+        for (auto n : cores) {
+            seeta::FaceDatabase db(setting, n, 1);
+            db.ExtractionCore()->set(seeta::FaceRecognizer::PROPERTY_NUMBER_THREADS, 1);
+            for (int i = 1; i < n; ++i) db.ExtractionCore(i)->set(seeta::FaceRecognizer::PROPERTY_NUMBER_THREADS, 1);
+            std::vector<seeta::ImageData> faces;
+            for (size_t i = 0; i < options.batch; ++i) faces.push_back(db.ExtractionCore()->CropFaceV2(image, POINTS));
+            std::vector<int64_t> index(options.batch);
+            results.push_back(Measure("register_parallel", { { "cores", double(n) }, { "batch", double(options.batch) } },
+                                      std::max<size_t>(1, options.iterations / options.batch), options.batch, [&]() {
+                for (size_t i = 0; i < options.batch; ++i) {
+                    Stamp(faces[i], ++counter);
+                    db.RegisterByCroppedFaceParallel(faces[i], &index[i]);
+                }
+                db.Join();
+            }));
+        }
+    }
+
+    void Usage() {
+        std::cerr << "Usage: seeta_fr_bench --model <model.json> [--output <result.json>] [--sizes 10000,100000,1000000]" << std::endl
+                  << "       [--cores 1,2,4] [--iterations 100] [--batch 32] [--workdir .]" << std::endl;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string key = argv[i];
+        const std::string value = argv[i + 1];
+        if (key == "--model") options.model = value;
+        else if (key == "--output") options.output = value;
+        else if (key == "--workdir") options.workdir = value;
+        else if (key == "--sizes") options.sizes = ParseList(value);
+        else if (key == "--iterations") options.iterations = std::max<size_t>(1, size_t(std::stoull(value)));
+        else if (key == "--batch") options.batch = std::max<size_t>(2, size_t(std::stoull(value)));
+        else if (key == "--cores") {
+            for (auto n : ParseList(value)) options.cores.push_back(int(n));
+        } else {
+            Usage();
+            return 1;
+        }
+    }
+    if (options.model.empty() || argc % 2 == 0) {
+        Usage();
+        return 1;
+    }
+    seeta::FaceDatabase::SetLogLevel(4);
+
+    seeta::ModelSetting setting;
+    setting.set_device(SEETA_DEVICE_CPU);
+    setting.append(options.model);
+
+    std::vector<Result> results;
+    BenchCrop(options, results);
+    BenchRecognizer(options, setting, results);
+    BenchDatabase(options, setting, results);
+    BenchRegister(options, setting, results);
+
+    if (options.output.empty()) {
+        seeta::bench::WriteJson(std::cout, "seeta_fr_bench", { { "model", options.model } }, results);
+    } else {
+        std::ofstream out(options.output);
+        seeta::bench::WriteJson(out, "seeta_fr_bench", { { "model", options.model } }, results);
+    }
+    return 0;
+}
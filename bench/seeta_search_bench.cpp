@@ -0,0 +1,292 @@
+//
+// Model-free search benchmark of database over synthetic clustered embeddings,
+// each search mode is timed and checked against exact brute force, results are written as JSON
+//
+
+#include "seeta/FaceDatabase.h"
+#include "BenchUtils.h"
+#include "SyntheticGallery.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+    using seeta::bench::Clock;
+    using seeta::bench::Measure;
+    using seeta::bench::Params;
+    using seeta::bench::ParseList;
+    using seeta::bench::Result;
+
+    struct Options {
+        std::string output;
+        seeta::bench::SyntheticSpec spec;
+        size_t probes = 1000;
+        double impostors = 0.2;  ///< fraction of probes of identities never enrolled
+        size_t k = 10;
+        float threshold = 0.5f;
+        std::vector<size_t> candidates = { 100, 1000 };  ///< prefilter candidates
+        std::vector<size_t> centroids = { 10, 100 };  ///< identity centroid candidates
+        int threads = 0;
+    };
+
+    /**
+     * queries of group vectors each, a query scores a row by mean inner product of its vectors
+     */
+    struct Queries {
+        size_t group = 1;
+        std::vector<float> features;
+        size_t size(size_t dim) const { return features.size() / (dim * group); }
+        const float *at(size_t i, size_t dim) const { return &features[i * group * dim]; }
+    };
+
+    /**
+     * ranked truth of each query
+     */
+    using Truth = std::vector<std::vector<int64_t>>;
+
+    /**
+     * exact scores of query against all rows
+     */
+    void Score(const float *query, size_t group, const std::vector<float> &rows, size_t dim, std::vector<float> &scores) {
+        const auto count = rows.size() / dim;
+        scores.assign(count, 0);
+        for (size_t g = 0; g < group; ++g) {
+            const auto probe = query + g * dim;
+            for (size_t r = 0; r < count; ++r) {
+                auto row = &rows[r * dim];
+                float dot = 0;
+                for (size_t i = 0; i < dim; ++i) dot += probe[i] * row[i];
+                scores[r] += dot / group;
+            }
+        }
+    }
+
+    /**
+     * best k of scores at least threshold, by score
+     */
+    std::vector<int64_t> Top(const std::vector<float> &scores, size_t k, float threshold) {
+        std::vector<int64_t> order;
+        for (size_t i = 0; i < scores.size(); ++i) if (scores[i] >= threshold) order.push_back(int64_t(i));
+        k = std::min(k, order.size());
+        std::partial_sort(order.begin(), order.begin() + k, order.end(), [&](int64_t a, int64_t b) {
+            return scores[a] > scores[b];
+        });
+        order.resize(k);
+        return order;
+    }
+
+    struct Exact {
+        Truth top;          ///< best k rows
+        Truth above;        ///< best k rows at least threshold
+        Truth identities;   ///< best k identities by best template
+    };
+
+    /**
+     * brute force over all rows, queries are split over threads
+     */
+    Exact BruteForce(const Queries &queries, const std::vector<float> &rows, const seeta::bench::SyntheticFaces &faces,
+                     const Options &options) {
+        const auto dim = options.spec.dim;
+        const auto count = queries.size(dim);
+        Exact exact;
+        exact.top.resize(count);
+        exact.above.resize(count);
+        exact.identities.resize(count);
+        const auto workers = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<std::thread> threads;
+        for (unsigned w = 0; w < workers; ++w) {
+            threads.emplace_back([&, w]() {
+                std::vector<float> scores;
+                std::vector<float> identity_scores;
+                for (size_t q = w; q < count; q += workers) {
+                    Score(queries.at(q, dim), queries.group, rows, dim, scores);
+                    exact.top[q] = Top(scores, options.k, -FLT_MAX);
+                    exact.above[q] = Top(scores, options.k, options.threshold);
+                    identity_scores.assign(options.spec.identities, -FLT_MAX);
+                    for (size_t r = 0; r < scores.size(); ++r) {
+                        auto &best = identity_scores[size_t(faces.identity_of(r))];
+                        best = std::max(best, scores[r]);
+                    }
+                    exact.identities[q] = Top(identity_scores, options.k, -FLT_MAX);
+                }
+            });
+        }
+        for (auto &thread : threads) thread.join();
+        return exact;
+    }
+
+    /**
+     * mean share of truth found in answer, queries with empty truth are skipped
+     */
+    double Recall(const Truth &answers, const Truth &truth) {
+        double sum = 0;
+        size_t counted = 0;
+        for (size_t q = 0; q < truth.size(); ++q) {
+            if (truth[q].empty()) continue;
+            std::set<int64_t> expected(truth[q].begin(), truth[q].end());
+            size_t found = 0;
+            for (auto id : answers[q]) found += expected.count(id);
+            sum += double(found) / truth[q].size();
+            ++counted;
+        }
+        return counted ? sum / counted : 1;
+    }
+
+    /**
+     * time search over each query once, then score answers against truth
+     */
+    template <typename SEARCH>
+    Result Run(const std::string &name, const Params &params, const Queries &queries, size_t dim, size_t k, const Truth &truth, SEARCH search) {
+        const auto count = queries.size(dim);
+        Truth answers(count);
+        size_t next = 0;
+        auto result = Measure(name, params, count, 1, [&]() {
+            const auto q = next++ % count;
+            auto &answer = answers[q];
+            answer.resize(k);
+            answer.resize(search(queries.at(q, dim), answer.data()));
+        });
+        const auto recall = Recall(answers, truth);
+        result.metrics.push_back({ "recall_at_k", recall });
+        std::cerr << name << ": recall@k " << recall << std::endl;
+        return result;
+    }
+
+    void Usage() {
+        std::cerr << "Usage: seeta_search_bench [--output <result.json>] [--dim 512] [--identities 10000] [--faces 10]" << std::endl
+                  << "       [--noise 0.5] [--impostors 0.2] [--probes 1000] [--k 10] [--threshold 0.5]" << std::endl
+                  << "       [--candidates 100,1000] [--centroids 10,100] [--threads 0] [--seed 1]" << std::endl;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+    auto &spec = options.spec;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        const std::string key = argv[i];
+        const std::string value = argv[i + 1];
+        if (key == "--output") options.output = value;
+        else if (key == "--dim") spec.dim = std::max<size_t>(1, size_t(std::stoull(value)));
+        else if (key == "--identities") spec.identities = std::max<size_t>(1, size_t(std::stoull(value)));
+        else if (key == "--faces") spec.faces_per_identity = std::max<size_t>(1, size_t(std::stoull(value)));
+        else if (key == "--noise") spec.noise = std::stof(value);
+        else if (key == "--seed") spec.seed = uint32_t(std::stoul(value));
+        else if (key == "--impostors") options.impostors = std::min(1.0, std::max(0.0, std::stod(value)));
+        else if (key == "--probes") options.probes = std::max<size_t>(1, size_t(std::stoull(value)));
+        else if (key == "--k") options.k = std::max<size_t>(1, size_t(std::stoull(value)));
+        else if (key == "--threshold") options.threshold = std::stof(value);
+        else if (key == "--candidates") options.candidates = ParseList(value);
+        else if (key == "--centroids") options.centroids = ParseList(value);
+        else if (key == "--threads") options.threads = std::stoi(value);
+        else {
+            Usage();
+            return 1;
+        }
+    }
+    if (argc % 2 == 0) {
+        Usage();
+        return 1;
+    }
+    seeta::FaceDatabase::SetLogLevel(4);
+
+    const auto dim = spec.dim;
+    const auto threads = options.threads > 0 ? options.threads : int(std::max(1u, std::thread::hardware_concurrency()));
+    seeta::bench::SyntheticFaces faces(spec);
+    const auto size = faces.gallery_size();
+
+    std::vector<float> rows(size * dim);
+    for (uint64_t r = 0; r < size; ++r) faces.gallery(r, &rows[r * dim]);
+
+    // impostors are the last probes, pairs for multi-probe are two unseen samples of one identity
+    Queries single;
+    single.features.resize(options.probes * dim);
+    Queries pairs;
+    pairs.group = 2;
+    pairs.features.resize(options.probes * 2 * dim);
+    const auto genuine = options.probes - size_t(options.probes * options.impostors);
+    for (size_t p = 0; p < options.probes; ++p) {
+        auto probe = &single.features[p * dim];
+        if (p < genuine) faces.genuine(p, probe);
+        else faces.impostor(p, probe);
+        std::copy(probe, probe + dim, &pairs.features[p * 2 * dim]);
+        if (p < genuine) faces.genuine(p, &pairs.features[(p * 2 + 1) * dim], 1);
+        else faces.impostor(p, &pairs.features[(p * 2 + 1) * dim], 1);
+    }
+
+    auto start = Clock::now();
+    const auto exact = BruteForce(single, rows, faces, options);
+    const auto exact_pairs = BruteForce(pairs, rows, faces, options);
+    std::cerr << "brute force of " << options.probes << " probes: "
+              << std::chrono::duration<double>(Clock::now() - start).count() << " s" << std::endl;
+
+    const Params gallery = {
+        { "gallery", double(size) }, { "dim", double(dim) }, { "identities", double(spec.identities) },
+        { "noise", spec.noise }, { "impostors", options.impostors }, { "threads", double(threads) }, { "k", double(options.k) },
+    };
+    auto with = [&](const Params &extra) {
+        auto params = gallery;
+        params.insert(params.end(), extra.begin(), extra.end());
+        return params;
+    };
+
+    std::vector<Result> results;
+    seeta::FaceDatabase db(int(dim), threads);
+    results.push_back(Measure("load", gallery, 1, size, [&]() {
+        seeta::bench::GalleryStream stream(size, dim, [&](uint64_t row, float *features) {
+            std::copy(&rows[row * dim], &rows[row * dim] + dim, features);
+        });
+        db.Load(stream);
+    }));
+    for (uint64_t r = 0; r < size; ++r) db.Bind(int64_t(r), faces.identity_of(r));
+
+    const auto k = options.k;
+    std::vector<float> similarity(k);
+    auto top = [&](const float *query, int64_t *index) {
+        return db.QueryTopByFeatures(query, k, index, similarity.data());
+    };
+    results.push_back(Run("query_top", with({ { "prefilter", 0 } }), single, dim, k, exact.top, top));
+    for (auto candidates : options.candidates) {
+        db.set(seeta::FaceDatabase::PROPERTY_PREFILTER_CANDIDATES, double(candidates));
+        results.push_back(Run("query_top", with({ { "prefilter", double(candidates) } }), single, dim, k, exact.top, top));
+    }
+    db.set(seeta::FaceDatabase::PROPERTY_PREFILTER_CANDIDATES, 0);
+
+    results.push_back(Run("query_top_multi_probe", with({ { "probes", 2 } }), pairs, dim, k, exact_pairs.top,
+                          [&](const float *query, int64_t *index) {
+        return db.QueryTopMultiProbe(query, 2, seeta::FaceDatabase::AGGREGATION_MEAN, k, index, similarity.data());
+    }));
+
+    auto identities = [&](const float *query, int64_t *identity) {
+        return db.QueryTopIdentitiesByFeatures(query, seeta::FaceDatabase::AGGREGATION_MAX, k, identity, similarity.data());
+    };
+    results.push_back(Run("query_top_identities", with({ { "centroids", 0 } }), single, dim, k, exact.identities, identities));
+    for (auto centroids : options.centroids) {
+        db.set(seeta::FaceDatabase::PROPERTY_CENTROID_CANDIDATES, double(centroids));
+        results.push_back(Run("query_top_identities", with({ { "centroids", double(centroids) } }), single, dim, k, exact.identities, identities));
+    }
+    db.set(seeta::FaceDatabase::PROPERTY_CENTROID_CANDIDATES, 0);
+
+    auto above = [&](const float *query, int64_t *index) {
+        return db.QueryAboveByFeatures(query, options.threshold, k, index, similarity.data());
+    };
+    const auto threshold = double(options.threshold);
+    results.push_back(Run("query_above", with({ { "threshold", threshold }, { "rotation", 0 } }), single, dim, k, exact.above, above));
+    // rotation is applied to stored rows, so it goes last
+    db.LearnRotation();
+    results.push_back(Run("query_above", with({ { "threshold", threshold }, { "rotation", 1 } }), single, dim, k, exact.above, above));
+    results.push_back(Run("query_top", with({ { "prefilter", 0 }, { "rotation", 1 } }), single, dim, k, exact.top, top));
+
+    if (options.output.empty()) {
+        seeta::bench::WriteJson(std::cout, "seeta_search_bench", {}, results);
+    } else {
+        std::ofstream out(options.output);
+        seeta::bench::WriteJson(out, "seeta_search_bench", {}, results);
+    }
+    return 0;
+}